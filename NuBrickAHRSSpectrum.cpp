@@ -0,0 +1,324 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickAHRSSpectrum.h"
+#include <math.h>
+
+#if (NUBRICK_AHRS_BLOCK_SIZE < 16) || (NUBRICK_AHRS_BLOCK_SIZE & (NUBRICK_AHRS_BLOCK_SIZE - 1))
+#error "NUBRICK_AHRS_BLOCK_SIZE must be power of 2, at least 16"
+#endif
+
+/* Thread flags of processing thread */
+#define NUBRICK_AHRS_FLAG_BLOCK0        0x1
+#define NUBRICK_AHRS_FLAG_BLOCK1        0x2
+#define NUBRICK_AHRS_FLAG_STOP          0x4
+
+/* Thread flag of capture thread */
+#define NUBRICK_AHRS_FLAG_CAPTURE_STOP  0x1
+
+NuBrickAHRSSpectrum::NuBrickAHRSSpectrum(NuBrickMasterAHRS &ahrs) :
+    _ahrs(ahrs), _features_valid(false), _sample_rate_hz(0),
+    _capture_thread(NULL), _process_thread(NULL), _running(false) {
+    
+    // No lock needed in the constructor
+    
+    const unsigned n = NUBRICK_AHRS_BLOCK_SIZE;
+    const float pi = 3.14159265358979f;
+    unsigned i;
+    
+    _block_busy[0] = _block_busy[1] = false;
+    memset(&_stats, 0x00, sizeof (_stats));
+    memset(&_features, 0x00, sizeof (_features));
+    
+    // Hann window
+    for (i = 0; i < n; i ++) {
+        _window[i] = 0.5f - 0.5f * cosf(2 * pi * i / n);
+    }
+    
+#if defined(NUBRICK_USE_CMSIS_DSP)
+    arm_rfft_fast_init_f32(&_rfft, n);
+#else
+    // Twiddle factors
+    for (i = 0; i < n / 2; i ++) {
+        _twiddle_cos[i] = cosf(2 * pi * i / n);
+        _twiddle_sin[i] = sinf(2 * pi * i / n);
+    }
+#endif
+}
+
+NuBrickAHRSSpectrum::~NuBrickAHRSSpectrum() {
+    
+    stop();
+}
+
+bool NuBrickAHRSSpectrum::start(uint32_t sample_rate_hz, FeaturesCallback cb) {
+    
+    if (_capture_thread) {
+        return true;
+    }
+    if (sample_rate_hz == 0 || ! _ahrs.get_field_mask("input.vibration")) {
+        return false;
+    }
+    
+    _mutex.lock();
+    _sample_rate_hz = sample_rate_hz;
+    _cb = cb;
+    _features_valid = false;
+    memset(&_stats, 0x00, sizeof (_stats));
+    _pace.reset();
+    _block_busy[0] = _block_busy[1] = false;
+    _mutex.unlock();
+    
+    _running = true;
+    _process_thread = new rtos::Thread(osPriorityBelowNormal);
+    _capture_thread = new rtos::Thread(osPriorityAboveNormal);
+    if (_process_thread->start(mbed::callback(this, &NuBrickAHRSSpectrum::process_main)) != osOK ||
+        _capture_thread->start(mbed::callback(this, &NuBrickAHRSSpectrum::capture_main)) != osOK) {
+        stop();
+        return false;
+    }
+    
+    return true;
+}
+
+void NuBrickAHRSSpectrum::stop(void) {
+    
+    _running = false;
+    
+    if (_capture_thread) {
+        _capture_thread->flags_set(NUBRICK_AHRS_FLAG_CAPTURE_STOP);
+        _capture_thread->join();
+        delete _capture_thread;
+        _capture_thread = NULL;
+    }
+    
+    if (_process_thread) {
+        _process_thread->flags_set(NUBRICK_AHRS_FLAG_STOP);
+        _process_thread->join();
+        delete _process_thread;
+        _process_thread = NULL;
+    }
+}
+
+bool NuBrickAHRSSpectrum::get_features(NuBrickSpectrumFeatures &features) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    bool valid = _features_valid;
+    features = _features;
+    
+    _mutex.unlock();
+    
+    return valid;
+}
+
+void NuBrickAHRSSpectrum::get_stats(NuBrickCaptureStats &stats) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    stats = _stats;
+    stats.num_samples = _pace.get_num_samples();
+    stats.jitter_mean = _pace.get_jitter_mean();
+    stats.jitter_max = _pace.get_jitter_max();
+    stats.rate = _pace.get_rate();
+    
+    _mutex.unlock();
+}
+
+void NuBrickAHRSSpectrum::capture_main(void) {
+    
+    NuBrickField &vibration = _ahrs["input.vibration"];
+    uint32_t period_us = 1000000 / _sample_rate_hz;
+    NuBrickPacer pacer;
+    uint64_t slot = 0;
+    unsigned block = 0;
+    unsigned pos = 0;
+    
+    pacer.start();
+    while (_running) {
+        // Wait for next sample time
+        uint64_t offset_us = slot * period_us;
+        pacer.wait_until(offset_us, NUBRICK_AHRS_FLAG_CAPTURE_STOP);
+        if (! _running) {
+            break;
+        }
+        slot ++;
+        
+        uint64_t now_us = pacer.elapsed_us();
+        uint32_t jitter = NuBrickPacer::abs_us((int64_t) now_us - (int64_t) offset_us);
+        
+        if (! _ahrs.pull_input_report()) {
+            _mutex.lock();
+            _stats.num_failures ++;
+            _mutex.unlock();
+            continue;
+        }
+        _blocks[block][pos ++] = vibration.get_value();
+        
+        _mutex.lock();
+        _pace.add(now_us, jitter);
+        _mutex.unlock();
+        
+        if (pos < NUBRICK_AHRS_BLOCK_SIZE) {
+            continue;
+        }
+        pos = 0;
+        
+        // Hand full block over and go on in the other one. If the other one is still being
+        // processed, drop this block rather than wait.
+        if (_block_busy[block ^ 1]) {
+            _mutex.lock();
+            _stats.dropped_blocks ++;
+            _mutex.unlock();
+            continue;
+        }
+        _block_busy[block] = true;
+        _process_thread->flags_set(block ? NUBRICK_AHRS_FLAG_BLOCK1 : NUBRICK_AHRS_FLAG_BLOCK0);
+        block ^= 1;
+    }
+}
+
+void NuBrickAHRSSpectrum::process_main(void) {
+    
+    uint32_t sequence = 0;
+    
+    while (_running) {
+        uint32_t flags = rtos::ThisThread::flags_wait_any(NUBRICK_AHRS_FLAG_BLOCK0 | NUBRICK_AHRS_FLAG_BLOCK1 | NUBRICK_AHRS_FLAG_STOP);
+        if ((flags & NUBRICK_AHRS_FLAG_STOP) || ! _running) {
+            break;
+        }
+        
+        unsigned block;
+        for (block = 0; block < 2; block ++) {
+            if (! (flags & (block ? NUBRICK_AHRS_FLAG_BLOCK1 : NUBRICK_AHRS_FLAG_BLOCK0))) {
+                continue;
+            }
+            
+            NuBrickSpectrumFeatures features;
+            process_block(_blocks[block], features);
+            features.sequence = sequence ++;
+            _block_busy[block] = false;
+            
+            _mutex.lock();
+            _features = features;
+            _features_valid = true;
+            FeaturesCallback cb = _cb;
+            _mutex.unlock();
+            
+            if (cb) {
+                cb(features);
+            }
+        }
+    }
+}
+
+void NuBrickAHRSSpectrum::process_block(const uint16_t *block, NuBrickSpectrumFeatures &features) {
+    
+    const unsigned n = NUBRICK_AHRS_BLOCK_SIZE;
+    float windowed[NUBRICK_AHRS_BLOCK_SIZE];
+    float mean = 0;
+    float sum_sq = 0;
+    unsigned i;
+    
+    for (i = 0; i < n; i ++) {
+        mean += block[i];
+    }
+    mean /= n;
+    
+    // Remove DC and apply window
+    for (i = 0; i < n; i ++) {
+        float x = block[i] - mean;
+        sum_sq += x * x;
+        windowed[i] = x * _window[i];
+    }
+    features.rms = sqrtf(sum_sq / n);
+    
+    power_spectrum(windowed);
+    
+    // Band energies over bins [0, n/2), and strongest bin except DC
+    const unsigned bins_per_band = (n / 2 + NUBRICK_AHRS_NUM_BANDS - 1) / NUBRICK_AHRS_NUM_BANDS;
+    unsigned peak_bin = 1;
+    for (i = 0; i < NUBRICK_AHRS_NUM_BANDS; i ++) {
+        features.band_energy[i] = 0;
+    }
+    for (i = 0; i < n / 2; i ++) {
+        features.band_energy[i / bins_per_band] += _power[i] / n;
+        if (i && _power[i] > _power[peak_bin]) {
+            peak_bin = i;
+        }
+    }
+    features.peak_freq = (float) peak_bin * _sample_rate_hz / n;
+}
+
+void NuBrickAHRSSpectrum::power_spectrum(const float *windowed) {
+    
+    const unsigned n = NUBRICK_AHRS_BLOCK_SIZE;
+    unsigned i;
+    
+#if defined(NUBRICK_USE_CMSIS_DSP)
+    // arm_rfft_fast_f32() modifies input
+    memcpy(_fft_in, windowed, sizeof (_fft_in));
+    arm_rfft_fast_f32(&_rfft, _fft_in, _fft_out, 0);
+    
+    // Packed output: DC and Nyquist real parts first, then complex bins
+    _power[0] = _fft_out[0] * _fft_out[0];
+    arm_cmplx_mag_squared_f32(_fft_out + 2, _power + 1, n / 2 - 1);
+#else
+    // Bit-reversed copy
+    unsigned bits = 0;
+    while ((1U << bits) < n) {
+        bits ++;
+    }
+    for (i = 0; i < n; i ++) {
+        unsigned rev = 0;
+        unsigned b;
+        for (b = 0; b < bits; b ++) {
+            rev |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        _fft_re[rev] = windowed[i];
+        _fft_im[rev] = 0;
+    }
+    
+    // Iterative radix-2 butterflies
+    unsigned len;
+    for (len = 2; len <= n; len <<= 1) {
+        unsigned half = len / 2;
+        unsigned step = n / len;
+        unsigned j, k;
+        
+        for (j = 0; j < n; j += len) {
+            for (k = 0; k < half; k ++) {
+                float wr = _twiddle_cos[k * step];
+                float wi = -_twiddle_sin[k * step];
+                float *a_re = _fft_re + j + k;
+                float *a_im = _fft_im + j + k;
+                float *b_re = a_re + half;
+                float *b_im = a_im + half;
+                float t_re = *b_re * wr - *b_im * wi;
+                float t_im = *b_re * wi + *b_im * wr;
+                
+                *b_re = *a_re - t_re;
+                *b_im = *a_im - t_im;
+                *a_re += t_re;
+                *a_im += t_im;
+            }
+        }
+    }
+    
+    for (i = 0; i < n / 2; i ++) {
+        _power[i] = _fft_re[i] * _fft_re[i] + _fft_im[i] * _fft_im[i];
+    }
+#endif
+}
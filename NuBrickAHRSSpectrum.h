@@ -0,0 +1,156 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_AHRS_SPECTRUM_H
+#define NUBRICK_AHRS_SPECTRUM_H
+
+#include "mbed.h"
+#include "NuBrickMasterAHRS.h"
+#include "NuBrickPacer.h"
+
+#if defined(NUBRICK_USE_CMSIS_DSP)
+#include "arm_math.h"
+#endif
+
+/** Block size of AHRS spectral analysis, power of 2
+ */
+#ifndef NUBRICK_AHRS_BLOCK_SIZE
+#define NUBRICK_AHRS_BLOCK_SIZE         128
+#endif
+
+/** Number of frequency bands of AHRS spectral analysis
+ */
+#ifndef NUBRICK_AHRS_NUM_BANDS
+#define NUBRICK_AHRS_NUM_BANDS          8
+#endif
+
+/** Spectral features of one block of "input.vibration"
+ */
+struct NuBrickSpectrumFeatures {
+    uint32_t    sequence;                           // Block sequence number
+    float       band_energy[NUBRICK_AHRS_NUM_BANDS];// Energy of equal-width bands from DC to Nyquist
+    float       rms;                                // RMS with mean removed
+    float       peak_freq;                          // Frequency of strongest bin in Hz
+};
+
+/** Statistics of AHRS capture
+ */
+struct NuBrickCaptureStats {
+    uint32_t    rate;                       // Achieved sample rate in mHz
+    uint32_t    jitter_mean;                // Mean lateness of sample against schedule in us
+    uint32_t    jitter_max;                 // Maximum lateness of sample against schedule in us
+    uint32_t    num_samples;                // Number of successful samples
+    uint32_t    num_failures;               // Number of failed samples
+    uint32_t    dropped_blocks;             // Number of blocks dropped for processing not keeping up
+};
+
+/** A spectral analysis stage of "input.vibration" of NuMaker Brick I2C slave module AHRS
+ *
+ * @note Synchronization level: Thread safe
+ *
+ * @details A capture thread samples "input.vibration" at fixed rate into one of two block
+ *          buffers. A full block is handed to a processing thread, which runs a Hann-windowed
+ *          FFT over it and publishes spectral features, while capture goes on in the other
+ *          buffer. Processing never stalls capture: if it can't keep up, blocks are dropped
+ *          and counted.
+ *
+ *          FFT uses CMSIS-DSP arm_rfft_fast_f32() with NUBRICK_USE_CMSIS_DSP defined, or a
+ *          portable radix-2 FFT otherwise.
+ */
+class NuBrickAHRSSpectrum {
+
+public:
+
+    /** Callback type of spectral features
+     *
+     *  @note Invoked in context of the processing thread
+     */
+    typedef mbed::Callback<void(const NuBrickSpectrumFeatures &features)> FeaturesCallback;
+
+    /** Create a spectral analysis stage
+     *
+     *  @param ahrs connected NuBrickMasterAHRS object
+     */
+    NuBrickAHRSSpectrum(NuBrickMasterAHRS &ahrs);
+
+    virtual ~NuBrickAHRSSpectrum();
+    
+    /** Start capture and processing
+     *
+     *  @param sample_rate_hz sample rate in Hz
+     *  @param cb callback invoked with spectral features of each block, optional
+     *  @return true if success, false if failure
+     */
+    bool start(uint32_t sample_rate_hz, FeaturesCallback cb = FeaturesCallback());
+    
+    /** Stop capture and processing
+     */
+    void stop(void);
+    
+    /** Get spectral features of the latest block
+     *
+     *  @return true if success, false if no block processed yet
+     */
+    bool get_features(NuBrickSpectrumFeatures &features);
+    
+    /** Get statistics of capture
+     */
+    void get_stats(NuBrickCaptureStats &stats);
+    
+protected:
+    NuBrickMasterAHRS &                 _ahrs;
+    uint16_t                            _blocks[2][NUBRICK_AHRS_BLOCK_SIZE];
+    volatile bool                       _block_busy[2];
+    float                               _window[NUBRICK_AHRS_BLOCK_SIZE];
+#if defined(NUBRICK_USE_CMSIS_DSP)
+    arm_rfft_fast_instance_f32          _rfft;
+    float                               _fft_in[NUBRICK_AHRS_BLOCK_SIZE];
+    float                               _fft_out[NUBRICK_AHRS_BLOCK_SIZE];
+#else
+    float                               _fft_re[NUBRICK_AHRS_BLOCK_SIZE];
+    float                               _fft_im[NUBRICK_AHRS_BLOCK_SIZE];
+    float                               _twiddle_cos[NUBRICK_AHRS_BLOCK_SIZE / 2];
+    float                               _twiddle_sin[NUBRICK_AHRS_BLOCK_SIZE / 2];
+#endif
+    float                               _power[NUBRICK_AHRS_BLOCK_SIZE / 2];
+    NuBrickSpectrumFeatures             _features;
+    bool                                _features_valid;
+    FeaturesCallback                    _cb;
+    uint32_t                            _sample_rate_hz;
+    NuBrickCaptureStats                 _stats;
+    NuBrickPaceStats                    _pace;
+    rtos::Mutex                         _mutex;
+    rtos::Thread *                      _capture_thread;
+    rtos::Thread *                      _process_thread;
+    volatile bool                       _running;
+    
+    /** Thread entry of capture
+     */
+    void capture_main(void);
+    
+    /** Thread entry of processing
+     */
+    void process_main(void);
+    
+    /** Compute spectral features of one block
+     */
+    void process_block(const uint16_t *block, NuBrickSpectrumFeatures &features);
+    
+    /** Compute power spectrum of windowed block into _power
+     */
+    void power_spectrum(const float *windowed);
+};
+
+#endif
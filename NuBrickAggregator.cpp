@@ -0,0 +1,176 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickAggregator.h"
+
+NuBrickAggregator::NuBrickAggregator(uint32_t window_ms, unsigned num_buckets) :
+    _buckets(NULL), _num_buckets(num_buckets ? num_buckets : 1), _bucket_ms(0),
+    _last(0), _master(NULL), _field(NULL), _field_mask(0), _observer(-1) {
+    
+    // No lock needed in the constructor
+    
+    _bucket_ms = window_ms / _num_buckets;
+    if (_bucket_ms == 0) {
+        _bucket_ms = 1;
+    }
+    
+    _buckets = new Bucket[_num_buckets];
+    memset(_buckets, 0x00, sizeof (Bucket) * _num_buckets);
+}
+
+NuBrickAggregator::~NuBrickAggregator() {
+    
+    detach();
+    
+    delete [] _buckets;
+}
+
+bool NuBrickAggregator::attach(NuBrickMaster &master, const char *report_field_name) {
+    
+    detach();
+    
+    // Check the field exists
+    _field_mask = master.get_field_mask(report_field_name);
+    if (! _field_mask) {
+        return false;
+    }
+    
+    _field = &master[report_field_name];
+    _observer = master.add_input_observer(mbed::callback(this, &NuBrickAggregator::on_input_report));
+    if (_observer < 0) {
+        _field = NULL;
+        return false;
+    }
+    _master = &master;
+    
+    return true;
+}
+
+void NuBrickAggregator::detach(void) {
+    
+    if (_master) {
+        _master->remove_input_observer(_observer);
+        _master = NULL;
+        _field = NULL;
+        _observer = -1;
+    }
+}
+
+void NuBrickAggregator::add_sample(uint16_t value) {
+    
+    uint32_t epoch = current_epoch();
+    
+    // Support thread-safe
+    _mutex.lock();
+    
+    Bucket *bucket = _buckets + (epoch % _num_buckets);
+    
+    // Recycle bucket left over from earlier window
+    if (bucket->epoch != epoch) {
+        bucket->epoch = epoch;
+        bucket->sum = 0;
+        bucket->count = 0;
+        bucket->minimum = value;
+        bucket->maximum = value;
+    }
+    
+    bucket->sum += value;
+    bucket->count ++;
+    if (value < bucket->minimum) {
+        bucket->minimum = value;
+    }
+    if (value > bucket->maximum) {
+        bucket->maximum = value;
+    }
+    
+    _last = value;
+    
+    _mutex.unlock();
+}
+
+bool NuBrickAggregator::get(NuBrickAggregate &aggr) {
+    
+    uint32_t epoch = current_epoch();
+    uint64_t sum = 0;
+    
+    aggr.minimum = 0xFFFF;
+    aggr.maximum = 0;
+    aggr.count = 0;
+    
+    // Support thread-safe
+    _mutex.lock();
+    
+    aggr.last = _last;
+    
+    unsigned i;
+    for (i = 0; i < _num_buckets; i ++) {
+        const Bucket *bucket = _buckets + i;
+        
+        // Skip empty bucket and bucket out of window
+        if (bucket->count == 0 || (epoch - bucket->epoch) >= _num_buckets) {
+            continue;
+        }
+        
+        sum += bucket->sum;
+        aggr.count += bucket->count;
+        if (bucket->minimum < aggr.minimum) {
+            aggr.minimum = bucket->minimum;
+        }
+        if (bucket->maximum > aggr.maximum) {
+            aggr.maximum = bucket->maximum;
+        }
+    }
+    
+    _mutex.unlock();
+    
+    if (aggr.count == 0) {
+        aggr.minimum = aggr.maximum = aggr.mean = 0;
+        return false;
+    }
+    
+    aggr.mean = (uint16_t) (sum / aggr.count);
+    
+    return true;
+}
+
+void NuBrickAggregator::reset(void) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    memset(_buckets, 0x00, sizeof (Bucket) * _num_buckets);
+    _last = 0;
+    
+    _mutex.unlock();
+}
+
+uint32_t NuBrickAggregator::current_epoch(void) {
+    
+    // Epoch starts from 1 to distinguish from empty bucket
+    return (uint32_t) (rtos::Kernel::Clock::now().time_since_epoch().count() / _bucket_ms) + 1;
+}
+
+void NuBrickAggregator::on_input_report(NuBrickMaster &master, uint32_t pulled_mask, uint32_t changed_mask) {
+    
+    // Sample on every pull of the field, changed or not
+    (void) master;
+    (void) changed_mask;
+    
+    // Partial pull of other fields, value of ours is not a new sample
+    if (! (pulled_mask & _field_mask)) {
+        return;
+    }
+    
+    add_sample(_field->get_value());
+}
@@ -0,0 +1,120 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_AGGREGATOR_H
+#define NUBRICK_AGGREGATOR_H
+
+#include "mbed.h"
+#include "NuBrickMaster.h"
+
+/** Aggregates of one input field over a window
+ */
+struct NuBrickAggregate {
+    uint16_t    minimum;                    // Minimum value over the window
+    uint16_t    maximum;                    // Maximum value over the window
+    uint16_t    mean;                       // Mean value over the window
+    uint16_t    last;                       // Last value
+    uint32_t    count;                      // Number of samples over the window
+};
+
+/** An incremental aggregation stage of one input field over a sliding window
+ *
+ * @note Synchronization level: Thread safe
+ *
+ * @details The window is divided into fixed number of buckets. Each sample updates the current
+ *          bucket in O(1) time. Reading aggregates combines buckets within the window. Memory
+ *          is fixed at construction. Reading doesn't take the NuBrickMaster lock.
+ *
+ *          Example: 1 s and 60 s windows of "input.temp"
+ *          @code
+ *          NuBrickAggregator temp_1s(1000, 10);
+ *          NuBrickAggregator temp_60s(60000, 60);
+ *          temp_1s.attach(master_temp, "input.temp");
+ *          temp_60s.attach(master_temp, "input.temp");
+ *          @endcode
+ */
+class NuBrickAggregator {
+
+public:
+
+    /** Create an aggregation stage
+     *
+     *  @param window_ms window length in ms
+     *  @param num_buckets number of buckets the window is divided into, i.e. resolution of window sliding
+     */
+    NuBrickAggregator(uint32_t window_ms, unsigned num_buckets = 10);
+
+    virtual ~NuBrickAggregator();
+    
+    /** Attach to one input field of NuBrick I2C slave module, e.g. "input.temp"
+     *
+     *  @param master NuBrickMaster object
+     *  @param report_field_name name of the input field
+     *  @return true if success, false if failure
+     *
+     *  @note Each pulled input report adds one sample.
+     */
+    bool attach(NuBrickMaster &master, const char *report_field_name);
+    
+    /** Detach from the input field attached by attach()
+     */
+    void detach(void);
+    
+    /** Add one sample
+     */
+    void add_sample(uint16_t value);
+    
+    /** Get aggregates over the window
+     *
+     *  @param aggr aggregates
+     *  @return true if success, false if no sample within the window
+     */
+    bool get(NuBrickAggregate &aggr);
+    
+    /** Clear all samples
+     */
+    void reset(void);
+    
+protected:
+    /** Aggregates of one bucket
+     */
+    struct Bucket {
+        uint32_t                        epoch;      // Bucket time in units of bucket length, 0 for empty
+        uint32_t                        sum;
+        uint32_t                        count;
+        uint16_t                        minimum;
+        uint16_t                        maximum;
+    };
+    
+    Bucket *                            _buckets;
+    unsigned                            _num_buckets;
+    uint32_t                            _bucket_ms;
+    uint16_t                            _last;
+    NuBrickMaster *                     _master;
+    NuBrickField *                      _field;
+    uint32_t                            _field_mask;
+    int                                 _observer;
+    rtos::Mutex                         _mutex;
+    
+    /** Get current time in units of bucket length
+     */
+    uint32_t current_epoch(void);
+    
+    /** Input report observer of the attached NuBrickMaster object
+     */
+    void on_input_report(NuBrickMaster &master, uint32_t pulled_mask, uint32_t changed_mask);
+};
+
+#endif
@@ -0,0 +1,325 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickBusWorker.h"
+#include "hal/us_ticker_api.h"
+
+NuBrickFuture::NuBrickFuture() :
+    _sem(0, 1), _done(false), _error(NuBrick_Error_None) {
+    
+    // No lock needed in the constructor
+}
+
+bool NuBrickFuture::wait(uint32_t timeout_ms) {
+    
+    if (_done) {
+        return true;
+    }
+    
+    return _sem.try_acquire_for(std::chrono::milliseconds(timeout_ms));
+}
+
+void NuBrickFuture::reset(void) {
+    
+    _sem.try_acquire();
+    _error = NuBrick_Error_None;
+    _done = false;
+}
+
+void NuBrickFuture::complete(NuBrickError error) {
+    
+    _error = error;
+    _done = true;
+    _sem.release();
+}
+
+NuBrickBusWorker::NuBrickBusWorker() :
+    _pending(0), _thread(NULL), _running(false), _submitting(0) {
+    
+    // No lock needed in the constructor
+    
+    memset(_overtaken, 0x00, sizeof (_overtaken));
+    memset(_stats, 0x00, sizeof (_stats));
+    memset(_latency_sum, 0x00, sizeof (_latency_sum));
+}
+
+NuBrickBusWorker::~NuBrickBusWorker() {
+    
+    stop();
+}
+
+bool NuBrickBusWorker::submit(NuBrickMaster &master, NuBrick_BusOp op, NuBrickFuture *future) {
+    
+    return submit(master, op, default_prio(op), future);
+}
+
+bool NuBrickBusWorker::submit(NuBrickMaster &master, NuBrick_BusOp op, CompletionCallback cb) {
+    
+    return submit(master, op, default_prio(op), cb);
+}
+
+bool NuBrickBusWorker::submit(NuBrickMaster &master, NuBrick_BusOp op, NuBrick_BusPrio prio, NuBrickFuture *future) {
+    
+    if (future == NULL) {
+        return false;
+    }
+    
+    future->reset();
+    return enqueue(master, op, prio, future, CompletionCallback());
+}
+
+bool NuBrickBusWorker::submit(NuBrickMaster &master, NuBrick_BusOp op, NuBrick_BusPrio prio, CompletionCallback cb) {
+    
+    return enqueue(master, op, prio, NULL, cb);
+}
+
+bool NuBrickBusWorker::start(osPriority priority) {
+    
+    if (_thread) {
+        return true;
+    }
+    
+    _running = true;
+    _thread = new rtos::Thread(priority);
+    if (_thread->start(mbed::callback(this, &NuBrickBusWorker::thread_main)) != osOK) {
+        delete _thread;
+        _thread = NULL;
+        _running = false;
+        return false;
+    }
+    
+    return true;
+}
+
+void NuBrickBusWorker::stop(void) {
+    
+    if (! _thread) {
+        return;
+    }
+    
+    _running = false;
+    
+    // Let submitters past the _running check put their requests, so none is left behind
+    // after the drain below. Sleep rather than yield to let lower-priority submitters run.
+    while (core_util_atomic_load_u32(&_submitting)) {
+        rtos::ThisThread::sleep_for(std::chrono::milliseconds(1));
+    }
+    
+    _pending.release();
+    _thread->join();
+    delete _thread;
+    _thread = NULL;
+    
+    // Cancel requests left
+    unsigned prio;
+    for (prio = 0; prio < NuBrick_BusPrio_Num; prio ++) {
+        Request *request;
+        while ((request = _queues[prio].try_get()) != NULL) {
+            cancel(request, (NuBrick_BusPrio) prio);
+        }
+    }
+    while (_pending.try_acquire()) {
+    }
+}
+
+bool NuBrickBusWorker::get_class_stats(NuBrick_BusPrio prio, NuBrickBusClassStats &stats) {
+    
+    if (prio >= NuBrick_BusPrio_Num) {
+        return false;
+    }
+    
+    // Support thread-safe
+    _stats_mutex.lock();
+    
+    stats = _stats[prio];
+    stats.latency_mean = _stats[prio].executed ? (uint32_t) (_latency_sum[prio] / _stats[prio].executed) : 0;
+    
+    _stats_mutex.unlock();
+    
+    return true;
+}
+
+void NuBrickBusWorker::reset_class_stats(void) {
+    // Support thread-safe
+    _stats_mutex.lock();
+    
+    memset(_stats, 0x00, sizeof (_stats));
+    memset(_latency_sum, 0x00, sizeof (_latency_sum));
+    
+    _stats_mutex.unlock();
+}
+
+NuBrick_BusPrio NuBrickBusWorker::default_prio(NuBrick_BusOp op) {
+    
+    return (op == NuBrick_BusOp_PushOutputReport) ? NuBrick_BusPrio_Urgent : NuBrick_BusPrio_Normal;
+}
+
+bool NuBrickBusWorker::enqueue(NuBrickMaster &master, NuBrick_BusOp op, NuBrick_BusPrio prio, NuBrickFuture *future, CompletionCallback cb) {
+    
+    if (prio >= NuBrick_BusPrio_Num) {
+        return false;
+    }
+    
+    // Count in flight before checking _running, so stop() waits for this put
+    core_util_atomic_incr_u32(&_submitting, 1);
+    bool queued = _running && put_request(master, op, prio, future, cb);
+    core_util_atomic_decr_u32(&_submitting, 1);
+    
+    return queued;
+}
+
+bool NuBrickBusWorker::put_request(NuBrickMaster &master, NuBrick_BusOp op, NuBrick_BusPrio prio, NuBrickFuture *future, CompletionCallback cb) {
+    
+    // Mail is bounded and never blocks here
+    Request *request = _queues[prio].try_alloc();
+    if (request == NULL) {
+        _stats_mutex.lock();
+        _stats[prio].rejected ++;
+        _stats_mutex.unlock();
+        return false;
+    }
+    
+    request->master = &master;
+    request->op = op;
+    request->future = future;
+    request->cb = cb;
+    request->submit_us = us_ticker_read();
+    _queues[prio].put(request);
+    _pending.release();
+    
+    return true;
+}
+
+NuBrickBusWorker::Request *NuBrickBusWorker::dequeue(NuBrick_BusPrio &prio) {
+    
+    Request *request = NULL;
+    unsigned cls;
+    
+    // Bounded waiting: serve lower class overtaken too often first
+    for (cls = NuBrick_BusPrio_Num - 1; cls > 0 && request == NULL; cls --) {
+        if (_overtaken[cls] >= NUBRICK_BUS_AGING_LIMIT) {
+            request = _queues[cls].try_get();
+            if (request) {
+                prio = (NuBrick_BusPrio) cls;
+                _stats_mutex.lock();
+                _stats[cls].aged ++;
+                _stats_mutex.unlock();
+            }
+        }
+    }
+    
+    // Highest class pending
+    for (cls = 0; cls < NuBrick_BusPrio_Num && request == NULL; cls ++) {
+        request = _queues[cls].try_get();
+        if (request) {
+            prio = (NuBrick_BusPrio) cls;
+        }
+    }
+    
+    if (request == NULL) {
+        return NULL;
+    }
+    
+    // Account overtaking of lower classes still pending
+    _overtaken[prio] = 0;
+    for (cls = prio + 1; cls < NuBrick_BusPrio_Num; cls ++) {
+        if (! _queues[cls].empty()) {
+            _overtaken[cls] ++;
+        }
+        else {
+            _overtaken[cls] = 0;
+        }
+    }
+    
+    return request;
+}
+
+void NuBrickBusWorker::execute(Request *request, NuBrick_BusPrio prio) {
+    
+    NuBrickMaster *master = request->master;
+    NuBrickError error = NuBrick_Error_InvalidArgument;
+    
+    // Error is of this call, other threads may use the master directly meanwhile
+    switch (request->op) {
+        case NuBrick_BusOp_PullInputReport:
+            master->pull_input_report(error);
+            break;
+        
+        case NuBrick_BusOp_PushOutputReport:
+            master->push_output_report(error);
+            break;
+        
+        case NuBrick_BusOp_PullFeatureReport:
+            master->pull_feature_report(error);
+            break;
+        
+        case NuBrick_BusOp_PushFeatureReport:
+            master->push_feature_report(error);
+            break;
+    }
+    
+    NuBrickFuture *future = request->future;
+    CompletionCallback cb = request->cb;
+    NuBrick_BusOp op = request->op;
+    uint32_t latency = us_ticker_read() - request->submit_us;
+    
+    _queues[prio].free(request);
+    
+    _stats_mutex.lock();
+    _stats[prio].executed ++;
+    _latency_sum[prio] += latency;
+    if (latency > _stats[prio].latency_max) {
+        _stats[prio].latency_max = latency;
+    }
+    _stats_mutex.unlock();
+    
+    if (future) {
+        future->complete(error);
+    }
+    if (cb) {
+        cb(*master, op, error);
+    }
+}
+
+void NuBrickBusWorker::cancel(Request *request, NuBrick_BusPrio prio) {
+    
+    NuBrickMaster *master = request->master;
+    NuBrickFuture *future = request->future;
+    CompletionCallback cb = request->cb;
+    NuBrick_BusOp op = request->op;
+    
+    _queues[prio].free(request);
+    
+    if (future) {
+        future->complete(NuBrick_Error_Cancelled);
+    }
+    if (cb) {
+        cb(*master, op, NuBrick_Error_Cancelled);
+    }
+}
+
+void NuBrickBusWorker::thread_main(void) {
+    
+    while (_running) {
+        // One count per request queued, plus one on stop()
+        _pending.acquire();
+        
+        NuBrick_BusPrio prio;
+        Request *request = _running ? dequeue(prio) : NULL;
+        if (request) {
+            execute(request, prio);
+        }
+    }
+}
@@ -0,0 +1,250 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_BUS_WORKER_H
+#define NUBRICK_BUS_WORKER_H
+
+#include "mbed.h"
+#include "NuBrickMaster.h"
+
+/** Number of pending requests per priority class of one NuBrickBusWorker object
+ */
+#ifndef NUBRICK_BUS_QUEUE_SIZE
+#define NUBRICK_BUS_QUEUE_SIZE          16
+#endif
+
+/** Number of higher-class requests a pending lower-class request may be overtaken by
+ *
+ *  @note Bounds waiting of low-priority work
+ */
+#ifndef NUBRICK_BUS_AGING_LIMIT
+#define NUBRICK_BUS_AGING_LIMIT         8
+#endif
+
+/** Bus request priority class
+ */
+enum NuBrick_BusPrio {
+    NuBrick_BusPrio_Urgent          = 0,    // e.g. actuator commands. Default of NuBrick_BusOp_PushOutputReport.
+    NuBrick_BusPrio_Normal          = 1,    // Default of other operations
+    NuBrick_BusPrio_Background      = 2,    // e.g. housekeeping pulls
+    NuBrick_BusPrio_Num             = 3,
+};
+
+/** Statistics of one bus request priority class
+ */
+struct NuBrickBusClassStats {
+    uint32_t    executed;                   // Number of requests executed
+    uint32_t    rejected;                   // Number of requests rejected for queue full
+    uint32_t    aged;                       // Number of requests served early for bounded waiting
+    uint32_t    latency_mean;               // Mean latency from submission to completion in us
+    uint32_t    latency_max;                // Maximum latency from submission to completion in us
+};
+
+/** Bus request operation
+ */
+enum NuBrick_BusOp {
+    NuBrick_BusOp_PullInputReport   = 0,    // NuBrickMaster::pull_input_report()
+    NuBrick_BusOp_PushOutputReport  = 1,    // NuBrickMaster::push_output_report()
+    NuBrick_BusOp_PullFeatureReport = 2,    // NuBrickMaster::pull_feature_report()
+    NuBrick_BusOp_PushFeatureReport = 3,    // NuBrickMaster::push_feature_report()
+};
+
+/** Completion of one bus request, waited on by the submitter
+ *
+ * @note Synchronization level: Thread safe
+ */
+class NuBrickFuture {
+    friend class NuBrickBusWorker;
+    
+public:
+    NuBrickFuture();
+    
+    /** Wait for completion
+     *
+     *  @param timeout_ms timeout in ms
+     *  @return true if completed, false if timed out
+     */
+    bool wait(uint32_t timeout_ms);
+    
+    /** Has request completed?
+     */
+    bool done(void) {
+        return _done;
+    }
+    
+    /** Get result of completed request
+     *
+     *  @return true if success, false if failure or not completed yet
+     */
+    bool result(void) {
+        return _done && _error == NuBrick_Error_None;
+    }
+    
+    /** Get error code of completed request
+     */
+    NuBrickError error(void) {
+        return _error;
+    }
+    
+protected:
+    /** Re-arm for submission
+     */
+    void reset(void);
+    
+    /** Complete request from worker thread
+     */
+    void complete(NuBrickError error);
+    
+    rtos::Semaphore                     _sem;
+    volatile bool                       _done;
+    NuBrickError                        _error;
+};
+
+/** A per-bus I/O worker thread executing pull/push requests of NuBrickMaster objects on one I2C bus
+ *
+ * @note Synchronization level: Thread safe
+ *
+ * @details Callers submit requests to a bounded queue without touching the bus, and get the
+ *          result through NuBrickFuture or a completion callback. The worker executes queued
+ *          requests back-to-back, so it is the one owner of the bus: the NuBrickMaster lock is
+ *          then uncontended and no lock is handed off across threads per transfer.
+ *
+ *          Requests are tagged with a priority class. The worker always takes the highest
+ *          class pending, e.g. urgent output pushes go ahead of queued input pulls, but a
+ *          pending lower-class request is overtaken by at most NUBRICK_BUS_AGING_LIMIT requests.
+ *          Requests are not preempted once started, so an urgent request waits for at most one
+ *          transfer in progress.
+ *
+ *          Use one NuBrickBusWorker object per I2C bus. Don't call pull/push methods of the
+ *          NuBrickMaster objects directly while the worker owns them.
+ */
+class NuBrickBusWorker {
+
+public:
+
+    /** Callback type of request completion
+     *
+     *  @note Invoked in context of the worker thread. Keep it short.
+     */
+    typedef mbed::Callback<void(NuBrickMaster &master, NuBrick_BusOp op, NuBrickError error)> CompletionCallback;
+
+    NuBrickBusWorker();
+
+    virtual ~NuBrickBusWorker();
+    
+    /** Submit request with future
+     *
+     *  @param master NuBrickMaster object on this bus
+     *  @param op operation
+     *  @param future future to complete, must stay alive until completed
+     *  @return true if queued, false if queue full or worker not started
+     *
+     *  @note Never blocks
+     */
+    bool submit(NuBrickMaster &master, NuBrick_BusOp op, NuBrickFuture *future);
+    
+    /** Submit request with completion callback
+     *
+     *  @return true if queued, false if queue full or worker not started
+     *
+     *  @note Never blocks
+     */
+    bool submit(NuBrickMaster &master, NuBrick_BusOp op, CompletionCallback cb);
+    
+    /** Submit request with future in specified priority class
+     *
+     *  @return true if queued, false if queue full or worker not started
+     */
+    bool submit(NuBrickMaster &master, NuBrick_BusOp op, NuBrick_BusPrio prio, NuBrickFuture *future);
+    
+    /** Submit request with completion callback in specified priority class
+     *
+     *  @return true if queued, false if queue full or worker not started
+     */
+    bool submit(NuBrickMaster &master, NuBrick_BusOp op, NuBrick_BusPrio prio, CompletionCallback cb);
+    
+    /** Start worker thread
+     *
+     *  @return true if success, false if failure
+     */
+    bool start(osPriority priority = osPriorityAboveNormal);
+    
+    /** Stop worker thread. Pending requests complete with NuBrick_Error_Cancelled.
+     */
+    void stop(void);
+    
+    /** Get statistics of one priority class
+     *
+     *  @return true if success, false if failure
+     */
+    bool get_class_stats(NuBrick_BusPrio prio, NuBrickBusClassStats &stats);
+    
+    /** Reset statistics of all priority classes
+     */
+    void reset_class_stats(void);
+    
+protected:
+    /** Queued request
+     */
+    struct Request {
+        NuBrickMaster *                 master;
+        NuBrick_BusOp                   op;
+        NuBrickFuture *                 future;
+        CompletionCallback              cb;
+        uint32_t                        submit_us;
+    };
+    
+    typedef rtos::Mail<Request, NUBRICK_BUS_QUEUE_SIZE> RequestQueue;
+    
+    RequestQueue                        _queues[NuBrick_BusPrio_Num];
+    rtos::Semaphore                     _pending;       // Number of requests queued in all classes
+    unsigned                            _overtaken[NuBrick_BusPrio_Num];
+    NuBrickBusClassStats                _stats[NuBrick_BusPrio_Num];
+    uint64_t                            _latency_sum[NuBrick_BusPrio_Num];
+    rtos::Mutex                         _stats_mutex;
+    rtos::Thread *                      _thread;
+    volatile bool                       _running;
+    volatile uint32_t                   _submitting;    // Number of enqueue() calls in flight, drained by stop()
+    
+    /** Default priority class of operation
+     */
+    static NuBrick_BusPrio default_prio(NuBrick_BusOp op);
+    
+    /** Queue one request
+     */
+    bool enqueue(NuBrickMaster &master, NuBrick_BusOp op, NuBrick_BusPrio prio, NuBrickFuture *future, CompletionCallback cb);
+    
+    /** Queue one request, with worker known running
+     */
+    bool put_request(NuBrickMaster &master, NuBrick_BusOp op, NuBrick_BusPrio prio, NuBrickFuture *future, CompletionCallback cb);
+    
+    /** Take next request: highest class pending, unless a lower class has been overtaken too often
+     */
+    Request *dequeue(NuBrick_BusPrio &prio);
+    
+    /** Execute one request and complete it
+     */
+    void execute(Request *request, NuBrick_BusPrio prio);
+    
+    /** Complete one request without executing it
+     */
+    void cancel(Request *request, NuBrick_BusPrio prio);
+    
+    /** Thread entry of start()
+     */
+    void thread_main(void);
+};
+
+#endif
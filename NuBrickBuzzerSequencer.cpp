@@ -0,0 +1,287 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickBuzzerSequencer.h"
+
+/* Thread flag to stop playing thread */
+#define NUBRICK_BUZZER_FLAG_STOP        0x1
+
+/* Maximum length of one pre-serialized feature frame */
+#define NUBRICK_BUZZER_FRAME_MAX        80
+
+NuBrickBuzzerSequencer::NuBrickBuzzerSequencer(NuBrickMasterBuzzer &buzzer) :
+    _buzzer(buzzer), _note_frames(NULL), _note_frame_same(NULL), _boundaries_ms(NULL), _errors_us(NULL), _rests(NULL),
+    _num_notes(0), _note_frame_len(0), _end_ms(0), _output_frame_len(0),
+    _thread(NULL), _running(false) {
+    
+    // No lock needed in the constructor
+    
+    memset(&_stats, 0x00, sizeof (_stats));
+}
+
+NuBrickBuzzerSequencer::~NuBrickBuzzerSequencer() {
+    
+    stop();
+    free_melody();
+}
+
+bool NuBrickBuzzerSequencer::compile(const NuBrickNote *notes, unsigned num_notes) {
+    
+    if (_running || notes == NULL || num_notes == 0) {
+        return false;
+    }
+    
+    // Reap thread of melody played
+    stop();
+    free_melody();
+    
+    int tone_pos = _buzzer.get_field_position("feature.tone");
+    int volume_pos = _buzzer.get_field_position("feature.volume");
+    int song_pos = _buzzer.get_field_position("feature.song");
+    int start_flag_pos = _buzzer.get_field_position("output.start_flag");
+    int stop_flag_pos = _buzzer.get_field_position("output.stop_flag");
+    if (tone_pos < 0 || volume_pos < 0 || song_pos < 0 || start_flag_pos < 0 || stop_flag_pos < 0) {
+        return false;
+    }
+    
+    // Other fields take current local values. Tone/volume/flags vary only in these copies,
+    // so local values seen by other threads are never touched.
+    uint16_t feature_values[NUBRICK_MAX_REPORT_FIELDS];
+    uint16_t output_values[NUBRICK_MAX_REPORT_FIELDS];
+    unsigned num_feature_values = _buzzer.get_feature_values(feature_values, NUBRICK_MAX_REPORT_FIELDS);
+    unsigned num_output_values = _buzzer.get_output_values(output_values, NUBRICK_MAX_REPORT_FIELDS);
+    uint8_t frame[NUBRICK_BUZZER_FRAME_MAX];
+    uint8_t start_frame[sizeof (_start_frame)];
+    uint8_t stop_frame[sizeof (_stop_frame)];
+    bool success = true;
+    unsigned i;
+    
+    // Start/stop output frames, shared by all notes
+    output_values[start_flag_pos] = 1;
+    output_values[stop_flag_pos] = 0;
+    unsigned output_frame_len = _buzzer.build_output_frame(output_values, num_output_values, start_frame, sizeof (start_frame));
+    output_values[start_flag_pos] = 0;
+    output_values[stop_flag_pos] = 1;
+    success = output_frame_len && (_buzzer.build_output_frame(output_values, num_output_values, stop_frame, sizeof (stop_frame)) == output_frame_len);
+    
+    // Build into locals, published under lock only when complete
+    uint8_t *note_frames = NULL;
+    unsigned note_frame_len = 0;
+    uint32_t *boundaries_ms = new uint32_t[num_notes];
+    int32_t *errors_us = new int32_t[num_notes];
+    bool *rests = new bool[num_notes];
+    bool *note_frame_same = new bool[num_notes];
+    
+    // One feature frame per note
+    uint32_t time_ms = 0;
+    feature_values[song_pos] = 0;
+    for (i = 0; i < num_notes && success; i ++) {
+        feature_values[tone_pos] = notes[i].tone;
+        feature_values[volume_pos] = notes[i].volume;
+        
+        unsigned len = _buzzer.build_feature_frame(feature_values, num_feature_values, frame, sizeof (frame));
+        if (len == 0) {
+            success = false;
+            break;
+        }
+        if (note_frames == NULL) {
+            note_frame_len = len;
+            note_frames = new uint8_t[num_notes * len];
+        }
+        
+        uint8_t *dst = note_frames + i * note_frame_len;
+        memcpy(dst, frame, note_frame_len);
+        note_frame_same[i] = i && memcmp(dst - note_frame_len, dst, note_frame_len) == 0;
+        rests[i] = (notes[i].tone == 0);
+        boundaries_ms[i] = time_ms;
+        // Not played yet
+        errors_us[i] = INT32_MIN;
+        time_ms += notes[i].duration_ms;
+    }
+    
+    if (! success) {
+        delete [] note_frames;
+        delete [] note_frame_same;
+        delete [] boundaries_ms;
+        delete [] errors_us;
+        delete [] rests;
+        return false;
+    }
+    
+    _mutex.lock();
+    _note_frames = note_frames;
+    _note_frame_same = note_frame_same;
+    _boundaries_ms = boundaries_ms;
+    _errors_us = errors_us;
+    _rests = rests;
+    _note_frame_len = note_frame_len;
+    memcpy(_start_frame, start_frame, output_frame_len);
+    memcpy(_stop_frame, stop_frame, output_frame_len);
+    _output_frame_len = output_frame_len;
+    _end_ms = time_ms;
+    _num_notes = num_notes;
+    _mutex.unlock();
+    
+    return true;
+}
+
+bool NuBrickBuzzerSequencer::start(osPriority priority) {
+    
+    if (_running) {
+        return true;
+    }
+    
+    // Reap thread of melody played
+    stop();
+    
+    if (_num_notes == 0) {
+        return false;
+    }
+    
+    _mutex.lock();
+    memset(&_stats, 0x00, sizeof (_stats));
+    _pace.reset();
+    unsigned i;
+    for (i = 0; i < _num_notes; i ++) {
+        _errors_us[i] = INT32_MIN;
+    }
+    _mutex.unlock();
+    
+    _running = true;
+    _thread = new rtos::Thread(priority);
+    if (_thread->start(mbed::callback(this, &NuBrickBuzzerSequencer::thread_main)) != osOK) {
+        delete _thread;
+        _thread = NULL;
+        _running = false;
+        return false;
+    }
+    
+    return true;
+}
+
+void NuBrickBuzzerSequencer::stop(void) {
+    
+    if (! _thread) {
+        return;
+    }
+    
+    _running = false;
+    _thread->flags_set(NUBRICK_BUZZER_FLAG_STOP);
+    _thread->join();
+    delete _thread;
+    _thread = NULL;
+}
+
+bool NuBrickBuzzerSequencer::get_timing_error(unsigned note, int32_t &error_us) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    bool played = (note < _num_notes) && (_errors_us[note] != INT32_MIN);
+    if (played) {
+        error_us = _errors_us[note];
+    }
+    
+    _mutex.unlock();
+    
+    return played;
+}
+
+void NuBrickBuzzerSequencer::get_stats(NuBrickSequencerStats &stats) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    stats = _stats;
+    stats.notes_played = _pace.get_num_samples();
+    stats.error_mean = _pace.get_jitter_mean();
+    stats.error_max = _pace.get_jitter_max();
+    
+    _mutex.unlock();
+}
+
+void NuBrickBuzzerSequencer::free_melody(void) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    delete [] _note_frames;
+    delete [] _note_frame_same;
+    delete [] _boundaries_ms;
+    delete [] _errors_us;
+    delete [] _rests;
+    _note_frames = NULL;
+    _note_frame_same = NULL;
+    _boundaries_ms = NULL;
+    _errors_us = NULL;
+    _rests = NULL;
+    _num_notes = 0;
+    
+    _mutex.unlock();
+}
+
+void NuBrickBuzzerSequencer::thread_main(void) {
+    
+    NuBrickPacer pacer;
+    bool sounding = false;
+    unsigned i;
+    
+    pacer.start();
+    for (i = 0; i < _num_notes && _running; i ++) {
+        uint64_t offset_us = (uint64_t) _boundaries_ms[i] * 1000;
+        pacer.wait_until(offset_us, NUBRICK_BUZZER_FLAG_STOP);
+        if (! _running) {
+            break;
+        }
+        
+        bool success = true;
+        if (_rests[i]) {
+            if (sounding) {
+                success = _buzzer.push_frame(_stop_frame, _output_frame_len);
+                sounding = ! success;
+            }
+        }
+        else {
+            if (! _note_frame_same[i] || ! sounding) {
+                success = _buzzer.push_frame(_note_frames + i * _note_frame_len, _note_frame_len);
+            }
+            if (success && ! sounding) {
+                success = _buzzer.push_frame(_start_frame, _output_frame_len);
+                sounding = success;
+            }
+        }
+        
+        // Note starts when its last frame is out
+        uint64_t now_us = pacer.elapsed_us();
+        int64_t error_us = (int64_t) now_us - (int64_t) offset_us;
+        uint32_t abs_error_us = NuBrickPacer::abs_us(error_us);
+        
+        _mutex.lock();
+        // Saturate, keeping INT32_MIN for not played
+        _errors_us[i] = (error_us > INT32_MAX) ? INT32_MAX : ((error_us <= INT32_MIN) ? (INT32_MIN + 1) : (int32_t) error_us);
+        if (! success) {
+            _stats.push_failures ++;
+        }
+        _pace.add(now_us, abs_error_us);
+        _mutex.unlock();
+    }
+    
+    // Wait for end of the last note unless stopped
+    if (_running) {
+        pacer.wait_until((uint64_t) _end_ms * 1000, NUBRICK_BUZZER_FLAG_STOP);
+    }
+    if (sounding) {
+        _buzzer.push_frame(_stop_frame, _output_frame_len);
+    }
+    
+    _running = false;
+}
@@ -0,0 +1,129 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_BUZZER_SEQUENCER_H
+#define NUBRICK_BUZZER_SEQUENCER_H
+
+#include "mbed.h"
+#include "NuBrickMasterBuzzer.h"
+#include "NuBrickPacer.h"
+
+/** One note of melody
+ */
+struct NuBrickNote {
+    uint16_t    tone;                       // Tone in Hz, "feature.tone", 0 for rest
+    uint16_t    volume;                     // Volume in %, "feature.volume"
+    uint32_t    duration_ms;                // Duration in ms
+};
+
+/** Statistics of melody playback
+ */
+struct NuBrickSequencerStats {
+    uint32_t    notes_played;               // Number of notes started
+    uint32_t    push_failures;              // Number of frames failed to push
+    uint32_t    error_mean;                 // Mean absolute timing error of note start in us
+    uint32_t    error_max;                  // Maximum absolute timing error of note start in us
+};
+
+/** A melody sequencer of NuMaker Brick I2C slave module Buzzer
+ *
+ * @note Synchronization level: Thread safe
+ *
+ * @details A melody is compiled once into pre-serialized feature report frames, one per note,
+ *          plus start/stop output report frames. A thread then pushes them as is at note
+ *          boundaries and measures timing error of each note start. Feature frames identical
+ *          to the previous note's are not pushed again.
+ */
+class NuBrickBuzzerSequencer {
+
+public:
+
+    /** Create a melody sequencer
+     *
+     *  @param buzzer connected NuBrickMasterBuzzer object
+     */
+    NuBrickBuzzerSequencer(NuBrickMasterBuzzer &buzzer);
+
+    virtual ~NuBrickBuzzerSequencer();
+    
+    /** Compile melody into pre-serialized frames
+     *
+     *  @param notes notes of the melody
+     *  @param num_notes number of notes
+     *  @return true if success, false if failure
+     *
+     *  @note Other feature fields, e.g. "feature.period", take current local values, except
+     *        "feature.song" which is set to 0 (mono). Local values themselves are left untouched.
+     */
+    bool compile(const NuBrickNote *notes, unsigned num_notes);
+    
+    /** Start playing melody once
+     *
+     *  @param priority priority of the playing thread
+     *  @return true if success, false if failure
+     */
+    bool start(osPriority priority = osPriorityAboveNormal);
+    
+    /** Stop playing melody
+     */
+    void stop(void);
+    
+    /** Is melody playing?
+     */
+    bool playing(void) {
+        return _running;
+    }
+    
+    /** Get measured timing error of one note start
+     *
+     *  @param note index of note
+     *  @param error_us timing error in us, positive for late
+     *  @return true if success, false if note not played yet
+     */
+    bool get_timing_error(unsigned note, int32_t &error_us);
+    
+    /** Get statistics of playback
+     */
+    void get_stats(NuBrickSequencerStats &stats);
+    
+protected:
+    NuBrickMasterBuzzer &               _buzzer;
+    uint8_t *                           _note_frames;
+    bool *                              _note_frame_same;   // Identical to the previous note's frame
+    uint32_t *                          _boundaries_ms;     // Note start relative to melody start
+    int32_t *                           _errors_us;
+    bool *                              _rests;
+    unsigned                            _num_notes;
+    unsigned                            _note_frame_len;
+    uint32_t                            _end_ms;
+    uint8_t                             _start_frame[16];
+    uint8_t                             _stop_frame[16];
+    unsigned                            _output_frame_len;
+    NuBrickSequencerStats               _stats;
+    NuBrickPaceStats                    _pace;
+    rtos::Mutex                         _mutex;
+    rtos::Thread *                      _thread;
+    volatile bool                       _running;
+    
+    /** Free compiled melody
+     */
+    void free_melody(void);
+    
+    /** Thread entry of start()
+     */
+    void thread_main(void);
+};
+
+#endif
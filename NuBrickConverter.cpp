@@ -0,0 +1,113 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickConverter.h"
+
+/* Normalize one value to [0, 1] in Q15 format, branch-free for vectorization */
+static inline int16_t nubrick_normalize(uint16_t value, uint16_t minimum, uint16_t maximum, uint32_t norm_scale) {
+    uint32_t clamped = value;
+    clamped = (clamped < minimum) ? minimum : clamped;
+    clamped = (clamped > maximum) ? maximum : clamped;
+    return (int16_t) (((clamped - minimum) * norm_scale) >> 16);
+}
+
+NuBrickConverter::NuBrickConverter() :
+    _max_value_pos(0), _num_fields(0) {
+    
+    // No lock needed in the constructor
+}
+
+bool NuBrickConverter::add_field(NuBrickField &field, unsigned value_pos) {
+    
+    if (_num_fields >= NUBRICK_MAX_CONVERT_FIELDS) {
+        return false;
+    }
+    
+    // Same guard as NuBrickField::update_norm_scale(): maximum below minimum collapses the range,
+    // so clamped - minimum never underflows
+    _minimum[_num_fields] = field._minimum;
+    _maximum[_num_fields] = (field._maximum > field._minimum) ? field._maximum : field._minimum;
+    _norm_scale[_num_fields] = field._norm_scale;
+    _unit_scale[_num_fields] = field._unit_scale;
+    _unit_offset[_num_fields] = field._unit_offset;
+    _value_pos[_num_fields] = value_pos;
+    if (value_pos > _max_value_pos) {
+        _max_value_pos = value_pos;
+    }
+    _num_fields ++;
+    
+    return true;
+}
+
+bool NuBrickConverter::normalize(const uint16_t *values, unsigned stride, int16_t *normalized, unsigned num_samples) {
+    
+    if (_num_fields && stride <= _max_value_pos) {
+        return false;
+    }
+    
+    const unsigned num_fields = _num_fields;
+    unsigned sample;
+    unsigned i;
+    
+    for (sample = 0; sample < num_samples; sample ++) {
+        const uint16_t *value_row = values + sample * stride;
+        int16_t *normalized_row = normalized + sample * num_fields;
+        
+        for (i = 0; i < num_fields; i ++) {
+            normalized_row[i] = nubrick_normalize(value_row[_value_pos[i]], _minimum[i], _maximum[i], _norm_scale[i]);
+        }
+    }
+    
+    return true;
+}
+
+bool NuBrickConverter::to_units(const uint16_t *values, unsigned stride, int32_t *units, unsigned num_samples) {
+    
+    if (_num_fields && stride <= _max_value_pos) {
+        return false;
+    }
+    
+    const unsigned num_fields = _num_fields;
+    unsigned sample;
+    unsigned i;
+    
+    for (sample = 0; sample < num_samples; sample ++) {
+        const uint16_t *value_row = values + sample * stride;
+        int32_t *unit_row = units + sample * num_fields;
+        
+        for (i = 0; i < num_fields; i ++) {
+            unit_row[i] = (int32_t) (((int64_t) value_row[_value_pos[i]] * _unit_scale[i]) >> 16) + _unit_offset[i];
+        }
+    }
+    
+    return true;
+}
+
+void NuBrickConverter::normalize_field(unsigned field_pos, const uint16_t *values, int16_t *normalized, unsigned num_samples) {
+    
+    if (field_pos >= _num_fields) {
+        return;
+    }
+    
+    // Hoist per-field scale factors out of the loop
+    const uint16_t minimum = _minimum[field_pos];
+    const uint16_t maximum = _maximum[field_pos];
+    const uint32_t norm_scale = _norm_scale[field_pos];
+    unsigned i;
+    
+    for (i = 0; i < num_samples; i ++) {
+        normalized[i] = nubrick_normalize(values[i], minimum, maximum, norm_scale);
+    }
+}
@@ -0,0 +1,120 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_CONVERTER_H
+#define NUBRICK_CONVERTER_H
+
+#include "mbed.h"
+#include "NuBrickField.h"
+
+/** Maximum number of fields converted by one NuBrickConverter object
+ */
+#ifndef NUBRICK_MAX_CONVERT_FIELDS
+#define NUBRICK_MAX_CONVERT_FIELDS      10
+#endif
+
+/** A batch converter of field values to normalized [0, 1] (Q15) and to physical units
+ *
+ * @note Synchronization level: Not protected
+ *
+ * @details Scale factors are pre-computed per field when the report descriptor is pulled in.
+ *          The converter keeps them in flat arrays so that whole reports, or whole captured
+ *          batches of reports, convert in one branch-free pass the compiler can vectorize.
+ *
+ *          Batches are in rows of stride values per sample, e.g. all input fields as captured
+ *          with NuBrickMaster::get_input_values(). Each field added is read at its position in
+ *          the row, and converted values come out in rows of num_fields() values per sample.
+ */
+class NuBrickConverter {
+
+public:
+
+    NuBrickConverter();
+
+    virtual ~NuBrickConverter() {
+        // Do nothing
+    }
+    
+    /** Add field to convert
+     *
+     *  @param field field of connected NuBrickMaster object, e.g. master_temp["input.temp"]
+     *  @param value_pos position of the field in one row of batch, e.g. 0 for the first input field
+     *  @return true if success, false if failure
+     *
+     *  @note Scale factors are copied. Add again after the report descriptor or unit
+     *        conversion changes.
+     */
+    bool add_field(NuBrickField &field, unsigned value_pos);
+    
+    /** Add field to convert, at position next to the last field added
+     */
+    bool add_field(NuBrickField &field) {
+        return add_field(field, _num_fields ? (_value_pos[_num_fields - 1] + 1) : 0);
+    }
+    
+    /** Remove all fields
+     */
+    void clear(void) {
+        _num_fields = 0;
+        _max_value_pos = 0;
+    }
+    
+    /** Get number of fields added
+     */
+    unsigned num_fields(void) {
+        return _num_fields;
+    }
+    
+    /** Convert batch of reports to normalized [0, 1] in Q15 format
+     *
+     *  @param values raw values, num_samples * stride
+     *  @param stride number of values per sample in values, greater than positions of all fields added
+     *  @param normalized normalized values, num_samples * num_fields()
+     *  @param num_samples number of reports in batch
+     *  @return true if success, false if stride too small
+     */
+    bool normalize(const uint16_t *values, unsigned stride, int16_t *normalized, unsigned num_samples);
+    
+    /** Convert batch of reports to physical units
+     *
+     *  @param values raw values, num_samples * stride
+     *  @param stride number of values per sample in values, greater than positions of all fields added
+     *  @param units values in physical units, num_samples * num_fields()
+     *  @param num_samples number of reports in batch
+     *  @return true if success, false if stride too small
+     */
+    bool to_units(const uint16_t *values, unsigned stride, int32_t *units, unsigned num_samples);
+    
+    /** Convert batch of samples of one field to normalized [0, 1] in Q15 format
+     *
+     *  @param field_pos position of field added
+     *  @param values raw values of the field, num_samples
+     *  @param normalized normalized values, num_samples
+     *  @param num_samples number of samples in batch
+     */
+    void normalize_field(unsigned field_pos, const uint16_t *values, int16_t *normalized, unsigned num_samples);
+    
+protected:
+    uint16_t                            _minimum[NUBRICK_MAX_CONVERT_FIELDS];
+    uint16_t                            _maximum[NUBRICK_MAX_CONVERT_FIELDS];
+    uint32_t                            _norm_scale[NUBRICK_MAX_CONVERT_FIELDS];
+    int32_t                             _unit_scale[NUBRICK_MAX_CONVERT_FIELDS];
+    int32_t                             _unit_offset[NUBRICK_MAX_CONVERT_FIELDS];
+    unsigned                            _value_pos[NUBRICK_MAX_CONVERT_FIELDS];
+    unsigned                            _max_value_pos;
+    unsigned                            _num_fields;
+};
+
+#endif
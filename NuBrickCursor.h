@@ -0,0 +1,116 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_CURSOR_H
+#define NUBRICK_CURSOR_H
+
+#include "mbed.h"
+#include "targets/TARGET_NUVOTON/nu_bitutil.h"
+
+/** A cursor over one frame of the NuMaker Brick HID-like protocol
+ *
+ * @note Synchronization level: Not protected
+ *
+ * @details Frame length is validated once against the layout with require() before decoding
+ *          or encoding. get*()/set*() then move on with no per-byte check. They must not go
+ *          past what has been required.
+ */
+class NuBrickCursor {
+
+public:
+    /** Create a cursor at start of frame
+     *
+     *  @param buf frame buffer
+     *  @param size frame length to decode, or buffer size to encode
+     */
+    NuBrickCursor(uint8_t *buf, unsigned size) :
+        _beg(buf), _pos(buf), _end(buf + size) {
+        // Do nothing
+    }
+
+    /** Check frame has at least n bytes left
+     *
+     *  @return true if so, false if frame is too short
+     */
+    bool require(unsigned n) const {
+        return (unsigned) (_end - _pos) >= n;
+    }
+
+    /** Get bytes left in frame
+     */
+    unsigned remaining(void) const {
+        return _end - _pos;
+    }
+
+    /** Get bytes passed since start of frame
+     */
+    unsigned offset(void) const {
+        return _pos - _beg;
+    }
+
+    /** Peek uint8_t at n bytes ahead, unchecked
+     */
+    uint8_t peek8(unsigned n) const {
+        return _pos[n];
+    }
+
+    /** Skip n bytes, unchecked
+     */
+    void skip(unsigned n) {
+        _pos += n;
+    }
+
+    /** Un-serialize uint8_t and advance, unchecked
+     */
+    uint8_t get8(void) {
+        return *_pos ++;
+    }
+
+    /** Un-serialize little-endian uint16_t and advance, unchecked
+     */
+    uint16_t get16_le(void) {
+        uint16_t val = nu_get16_le(_pos);
+        _pos += 2;
+        return val;
+    }
+
+    /** Un-serialize big-endian uint16_t and advance, unchecked
+     */
+    uint16_t get16_be(void) {
+        uint16_t val = nu_get16_be(_pos);
+        _pos += 2;
+        return val;
+    }
+
+    /** Serialize uint8_t and advance, unchecked
+     */
+    void set8(uint8_t val) {
+        *_pos ++ = val;
+    }
+
+    /** Serialize little-endian uint16_t and advance, unchecked
+     */
+    void set16_le(uint16_t val) {
+        nu_set16_le(_pos, val);
+        _pos += 2;
+    }
+
+private:
+    uint8_t *                           _beg;
+    uint8_t *                           _pos;
+    uint8_t *                           _end;
+};
+
+#endif
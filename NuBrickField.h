@@ -26,6 +26,7 @@
  */
 class NuBrickField {
     friend class NuBrickMaster;
+    friend class NuBrickConverter;
     
 public:
     typedef std::pair<uint16_t, const char *> IndexName;
@@ -37,6 +38,10 @@ public:
         _minimum(0),
         _maximum(0),
         _value(0),
+        _norm_scale(0),
+        _unit_scale(0x10000),
+        _unit_offset(0),
+        _updated(0),
         _name(name) {
         // Do nothing
     };
@@ -65,12 +70,80 @@ public:
         _value = value;
     }
     
+    /** Get value of the open field of a NuBrick device normalized to [0, 1] in Q15 format
+     *
+     *  @note Normalized by minimum/maximum from report descriptor. Value out of range is clamped.
+     */
+    int16_t get_normalized(void) {
+        return normalize(_value);
+    }
+    
+    /** Set conversion of the open field of a NuBrick device to physical units
+     *
+     *  @param scale scale in Q16 format
+     *  @param offset offset in physical units
+     *
+     *  @note Value in physical units = value * scale / 65536 + offset. Default to value as is.
+     */
+    void set_unit_conversion(int32_t scale, int32_t offset) {
+        _unit_scale = scale;
+        _unit_offset = offset;
+    }
+    
+    /** Get value of the open field of a NuBrick device in physical units
+     */
+    int32_t get_unit_value(void) {
+        return (int32_t) (((int64_t) _value * _unit_scale) >> 16) + _unit_offset;
+    }
+    
+    /** Get age in ms of value of the open field of a NuBrick device, i.e. time since it was last pulled
+     *
+     *  @return age in ms, or 0xFFFFFFFF if never pulled
+     *
+     *  @note Only input report fields are tracked. Both full and partial pulls of input report count.
+     */
+    uint32_t get_age(void) {
+        uint32_t updated = _updated;
+        if (updated == 0) {
+            return 0xFFFFFFFF;
+        }
+        return (uint32_t) rtos::Kernel::Clock::now().time_since_epoch().count() - updated;
+    }
+    
 private:
+    /** Mark value just pulled, for get_age()
+     */
+    void touch(rtos::Kernel::Clock::time_point now) {
+        uint32_t updated = (uint32_t) now.time_since_epoch().count();
+        // 0 is reserved for never pulled
+        _updated = updated ? updated : 1;
+    }
+    
+    /** Pre-compute scale factor for normalization once minimum/maximum are known
+     */
+    void update_norm_scale(void) {
+        uint32_t range = (_maximum > _minimum) ? (_maximum - _minimum) : 1;
+        _norm_scale = (0x7FFFUL << 16) / range;
+    }
+    
+    /** Normalize value to [0, 1] in Q15 format
+     */
+    int16_t normalize(uint16_t value) {
+        // Clamp to maximum first, so maximum below minimum collapses to minimum rather than underflows
+        uint16_t clamped = (value > _maximum) ? _maximum : value;
+        clamped = (clamped < _minimum) ? _minimum : clamped;
+        return (int16_t) (((uint32_t) (clamped - _minimum) * _norm_scale) >> 16);
+    }
+    
     uint16_t        _field_index;
     uint16_t        _length;
     uint16_t        _minimum;
     uint16_t        _maximum;
     uint16_t        _value;
+    uint32_t        _norm_scale;
+    int32_t         _unit_scale;
+    int32_t         _unit_offset;
+    volatile uint32_t _updated;     // Kernel tick in ms of last pull, 0 if never pulled
     const char *    _name;
 };
 
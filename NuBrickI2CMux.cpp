@@ -0,0 +1,124 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickI2CMux.h"
+
+NuBrickI2CMux *NuBrickI2CMux::_list = NULL;
+
+NuBrickI2CMux::NuBrickI2CMux(I2C &i2c, int i2c_addr) :
+    _i2c(i2c), _i2c_addr(i2c_addr), _channel(-1), _num_switches(0), _next(NULL) {
+    
+    // Link into mux list, walked by other muxes and NuBrickMaster objects with the bus lock
+    core_util_critical_section_enter();
+    _next = _list;
+    _list = this;
+    core_util_critical_section_exit();
+}
+
+NuBrickI2CMux::~NuBrickI2CMux() {
+    
+    core_util_critical_section_enter();
+    NuBrickI2CMux **link = &_list;
+    while (*link && *link != this) {
+        link = &(*link)->_next;
+    }
+    if (*link) {
+        *link = _next;
+    }
+    core_util_critical_section_exit();
+}
+
+NuBrickI2CMux *NuBrickI2CMux::get_first(I2C &i2c) {
+    
+    NuBrickI2CMux *mux = _list;
+    while (mux && &mux->_i2c != &i2c) {
+        mux = mux->_next;
+    }
+    
+    return mux;
+}
+
+NuBrickI2CMux *NuBrickI2CMux::get_next(void) {
+    
+    NuBrickI2CMux *mux = _next;
+    while (mux && &mux->_i2c != &_i2c) {
+        mux = mux->_next;
+    }
+    
+    return mux;
+}
+
+bool NuBrickI2CMux::select(int channel) {
+    
+    if (channel < -1 || channel >= NUBRICK_I2C_MUX_NUM_CHANNELS) {
+        return false;
+    }
+    
+    // Support thread-safe
+    _i2c.lock();
+    
+    uint8_t ctrl;
+    bool success = close_others();
+    if (success && prepare_select(channel, ctrl)) {
+        success = (_i2c.write(_i2c_addr, (const char *) &ctrl, 1) == 0);
+        end_select(channel, success);
+    }
+    
+    _i2c.unlock();
+    
+    return success;
+}
+
+bool NuBrickI2CMux::prepare_select(int channel, uint8_t &ctrl) {
+    
+    // Already selected or closed, no mux write
+    if (channel == _channel) {
+        return false;
+    }
+    
+    // Control register: one bit per channel, only one enabled at a time
+    ctrl = (channel >= 0) ? (uint8_t) (1 << channel) : 0;
+    
+    return true;
+}
+
+void NuBrickI2CMux::end_select(int channel, bool success) {
+    
+    if (! success) {
+        // Mux state unknown after failure
+        _channel = NUBRICK_I2C_MUX_CHANNEL_UNKNOWN;
+        return;
+    }
+    
+    _channel = channel;
+    _num_switches = _num_switches + 1;
+}
+
+bool NuBrickI2CMux::close_others(void) {
+    
+    NuBrickI2CMux *mux;
+    for (mux = get_first(_i2c); mux; mux = mux->get_next()) {
+        uint8_t ctrl;
+        if (mux != this && mux->prepare_select(-1, ctrl)) {
+            bool success = (_i2c.write(mux->_i2c_addr, (const char *) &ctrl, 1) == 0);
+            mux->end_select(-1, success);
+            if (! success) {
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
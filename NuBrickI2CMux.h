@@ -0,0 +1,146 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_I2C_MUX_H
+#define NUBRICK_I2C_MUX_H
+
+#include "mbed.h"
+
+/** Default 8-bit I2C address of TCA9548A-style mux, with A0~A2 tied low
+ */
+#ifndef NUBRICK_I2C_MUX_ADDR_DEFAULT
+#define NUBRICK_I2C_MUX_ADDR_DEFAULT    (0x70 << 1)
+#endif
+
+/** Number of channels of TCA9548A-style mux
+ */
+#define NUBRICK_I2C_MUX_NUM_CHANNELS    8
+
+/** Cached channel of a mux in unknown state, e.g. after a failed write
+ *
+ *  @note For internal use
+ */
+#define NUBRICK_I2C_MUX_CHANNEL_UNKNOWN (-2)
+
+/** A TCA9548A-style I2C mux, fanning one I2C bus out to 8 channels
+ *
+ * @note Synchronization level: Thread safe, with the bus lock
+ *
+ * @details Bricks of the same type share one address, so they go on different channels.
+ *          Attach the mux to each NuBrickMaster object with NuBrickMaster::attach_mux(), and
+ *          the channel gets selected on each transaction. The current channel is cached, so
+ *          the mux is written only on a channel switch. NuBrickMaster writes the mux through
+ *          its own bus path with prepare_select()/end_select(), so the write shows in its
+ *          transaction statistics, trace and recording.
+ *
+ *          Several muxes may share one bus. Selecting a channel of one mux closes the channels
+ *          of the others on the bus first, and a brick on the bus directly closes all of them,
+ *          so bricks of the same type behind different muxes or on the bus never answer together.
+ *          Create all muxes before bus traffic starts, and keep them alive while the bus is in use.
+ */
+class NuBrickI2CMux {
+
+public:
+
+    /** Create a mux on I2C bus
+     *
+     *  @param i2c I2C object, the same one as of NuBrickMaster objects behind the mux
+     *  @param i2c_addr 8-bit I2C address of the mux [ addr | 0 ]
+     */
+    NuBrickI2CMux(I2C &i2c, int i2c_addr = NUBRICK_I2C_MUX_ADDR_DEFAULT);
+    
+    virtual ~NuBrickI2CMux();
+    
+    /** Get first mux on I2C bus, to walk all muxes on it with get_next()
+     *
+     *  @return first mux, NULL if none
+     *
+     *  @note Called with the bus lock held
+     */
+    static NuBrickI2CMux *get_first(I2C &i2c);
+    
+    /** Get next mux on the same I2C bus
+     *
+     *  @return next mux, NULL if none
+     */
+    NuBrickI2CMux *get_next(void);
+    
+    /** Select channel, written to the mux only if not selected yet. Other muxes on the bus get closed first.
+     *
+     *  @param channel channel 0~7, or -1 to disconnect all channels
+     *  @return true if success, false if failure
+     *
+     *  @note Called with the bus lock held, so the channel stays until the transaction ends
+     */
+    bool select(int channel);
+    
+    /** Prepare selecting channel, for a caller writing the mux itself
+     *
+     *  @param channel channel 0~7, or -1 to disconnect all channels
+     *  @param ctrl control byte to write to the mux
+     *  @return true if the mux needs writing, false if channel is selected or all closed already
+     *
+     *  @note Called with the bus lock held. Follow a true return with end_select().
+     */
+    bool prepare_select(int channel, uint8_t &ctrl);
+    
+    /** End selecting channel after the caller has written the control byte
+     *
+     *  @param channel channel passed to prepare_select()
+     *  @param success true if the mux acked the write
+     */
+    void end_select(int channel, bool success);
+    
+    /** Get 8-bit I2C address of the mux
+     */
+    int get_i2c_addr(void) {
+        return _i2c_addr;
+    }
+    
+    /** Get current channel, -1 if none or unknown
+     */
+    int get_channel(void) {
+        return (_channel >= 0) ? _channel : -1;
+    }
+    
+    /** Get number of channel switches written to the mux
+     */
+    uint32_t get_num_switches(void) {
+        return _num_switches;
+    }
+    
+    /** Forget cached channel, e.g. after the mux gets reset. Next select() writes the mux anyway.
+     */
+    void invalidate(void) {
+        _channel = NUBRICK_I2C_MUX_CHANNEL_UNKNOWN;
+    }
+    
+protected:
+    I2C &                               _i2c;
+    int                                 _i2c_addr;
+    volatile int                        _channel;       // -1 if all closed, NUBRICK_I2C_MUX_CHANNEL_UNKNOWN if unknown
+    volatile uint32_t                   _num_switches;
+    NuBrickI2CMux *                     _next;
+    
+    static NuBrickI2CMux *              _list;          // All muxes, of any bus
+    
+    /** Close channels of other muxes on the same bus, written with the I2C object
+     *
+     *  @note Called with the bus lock held
+     */
+    bool close_others(void);
+};
+
+#endif
@@ -0,0 +1,230 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickIRCodes.h"
+
+/* Maximum length of one feature/output frame */
+#define NUBRICK_IR_FRAME_MAX            80
+
+NuBrickIRCodes::NuBrickIRCodes(NuBrickMasterIR &ir) :
+    _ir(ir),
+    _using_data_type_pos(ir.get_field_position("feature.using_data_type")),
+    _index_orig_data_to_send_pos(ir.get_field_position("feature.index_orig_data_to_send")),
+    _index_learned_data_to_send_pos(ir.get_field_position("feature.index_learned_data_to_send")),
+    _num_learned_data(ir["feature.num_learned_data"]),
+    _received_data_flag(ir["input.received_data_flag"]),
+    _send_IR_flag_pos(ir.get_field_position("output.send_IR_flag")),
+    _learn_IR_flag_pos(ir.get_field_position("output.learn_IR_flag")),
+    _num_codes(0), _cache_valid(false), _cache_data_type(0), _cache_index(0), _num_transfers(0), _learning(false) {
+    
+    // No lock needed in the constructor
+}
+
+bool NuBrickIRCodes::add_code(const char *name, uint16_t index, NuBrick_IRDataType data_type) {
+    
+    if (name == NULL) {
+        return false;
+    }
+    
+    // Support thread-safe
+    _mutex.lock();
+    
+    bool success = put_code(name, index, data_type);
+    
+    _mutex.unlock();
+    
+    return success;
+}
+
+bool NuBrickIRCodes::send(const char *name) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    // Fail fast rather than break the learn session
+    Code *code = find_code(name);
+    if (code == NULL || _learning || ! sync()) {
+        _mutex.unlock();
+        return false;
+    }
+    
+    // Push feature report only when the code to send changes
+    if (code->data_type != _cache_data_type || code->index != _cache_index) {
+        // Change a local copy only, never the shared local fields
+        uint16_t values[NUBRICK_MAX_REPORT_FIELDS];
+        uint8_t frame[NUBRICK_IR_FRAME_MAX];
+        unsigned num_values = _ir.get_feature_values(values, NUBRICK_MAX_REPORT_FIELDS);
+        values[_using_data_type_pos] = code->data_type;
+        if (code->data_type == NuBrick_IRDataType_Learned) {
+            values[_index_learned_data_to_send_pos] = code->index;
+        }
+        else {
+            values[_index_orig_data_to_send_pos] = code->index;
+        }
+        
+        core_util_atomic_incr_u32(&_num_transfers, 1);
+        unsigned length = _ir.build_feature_frame(values, num_values, frame, sizeof (frame));
+        if (length == 0 || ! _ir.push_frame(frame, length)) {
+            // Module state unknown now
+            _cache_valid = false;
+            _mutex.unlock();
+            return false;
+        }
+        _cache_data_type = code->data_type;
+        _cache_index = code->index;
+    }
+    
+    bool success = push_flags(1, 0);
+    
+    _mutex.unlock();
+    
+    return success;
+}
+
+bool NuBrickIRCodes::learn(const char *name, uint32_t timeout_ms, uint32_t poll_ms) {
+    
+    if (name == NULL || poll_ms == 0) {
+        return false;
+    }
+    
+    // Support thread-safe
+    _mutex.lock();
+    
+    // One learn session at a time
+    if (_learning) {
+        _mutex.unlock();
+        return false;
+    }
+    
+    // Start learn session
+    if (! push_flags(0, 1)) {
+        _mutex.unlock();
+        return false;
+    }
+    _learning = true;
+    
+    _mutex.unlock();
+    
+    // Wait for IR data received, without the lock
+    bool received = false;
+    uint32_t waited_ms = 0;
+    while (waited_ms < timeout_ms) {
+        core_util_atomic_incr_u32(&_num_transfers, 1);
+        if (_ir.pull_input_report() && _received_data_flag.get_value()) {
+            received = true;
+            break;
+        }
+        rtos::ThisThread::sleep_for(std::chrono::milliseconds(poll_ms));
+        waited_ms += poll_ms;
+    }
+    
+    _mutex.lock();
+    
+    // End learn session
+    bool success = push_flags(0, 0) && received;
+    _learning = false;
+    
+    // Learned code goes last
+    if (success) {
+        _cache_valid = false;
+        success = sync();
+    }
+    if (success) {
+        uint16_t num_learned = _num_learned_data.get_value();
+        success = num_learned && put_code(name, num_learned - 1, NuBrick_IRDataType_Learned);
+    }
+    
+    _mutex.unlock();
+    
+    return success;
+}
+void NuBrickIRCodes::invalidate(void) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    _cache_valid = false;
+    
+    _mutex.unlock();
+}
+
+bool NuBrickIRCodes::sync(void) {
+    
+    if (_cache_valid) {
+        return true;
+    }
+    
+    core_util_atomic_incr_u32(&_num_transfers, 1);
+    if (! _ir.pull_feature_report()) {
+        return false;
+    }
+    
+    uint16_t values[NUBRICK_MAX_REPORT_FIELDS];
+    _ir.get_feature_values(values, NUBRICK_MAX_REPORT_FIELDS);
+    _cache_data_type = values[_using_data_type_pos];
+    _cache_index = (_cache_data_type == NuBrick_IRDataType_Learned) ?
+        values[_index_learned_data_to_send_pos] :
+        values[_index_orig_data_to_send_pos];
+    _cache_valid = true;
+    
+    return true;
+}
+
+NuBrickIRCodes::Code *NuBrickIRCodes::find_code(const char *name) {
+    
+    if (name == NULL) {
+        return NULL;
+    }
+    
+    unsigned i;
+    for (i = 0; i < _num_codes; i ++) {
+        if (strcmp(_codes[i].name, name) == 0) {
+            return _codes + i;
+        }
+    }
+    
+    return NULL;
+}
+
+bool NuBrickIRCodes::put_code(const char *name, uint16_t index, NuBrick_IRDataType data_type) {
+    
+    Code *code = find_code(name);
+    if (code == NULL) {
+        if (_num_codes >= NUBRICK_MAX_IR_CODES) {
+            return false;
+        }
+        code = _codes + _num_codes;
+        _num_codes ++;
+    }
+    
+    code->name = name;
+    code->index = index;
+    code->data_type = data_type;
+    
+    return true;
+}
+
+bool NuBrickIRCodes::push_flags(uint16_t send_flag, uint16_t learn_flag) {
+    
+    // Change a local copy only, never the shared local fields
+    uint16_t values[NUBRICK_MAX_REPORT_FIELDS];
+    uint8_t frame[NUBRICK_IR_FRAME_MAX];
+    unsigned num_values = _ir.get_output_values(values, NUBRICK_MAX_REPORT_FIELDS);
+    values[_send_IR_flag_pos] = send_flag;
+    values[_learn_IR_flag_pos] = learn_flag;
+    
+    core_util_atomic_incr_u32(&_num_transfers, 1);
+    unsigned length = _ir.build_output_frame(values, num_values, frame, sizeof (frame));
+    
+    return length && _ir.push_frame(frame, length);
+}
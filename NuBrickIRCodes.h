@@ -0,0 +1,141 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_IR_CODES_H
+#define NUBRICK_IR_CODES_H
+
+#include "mbed.h"
+#include "NuBrickMasterIR.h"
+
+/** Maximum number of named IR codes of one NuBrickIRCodes object
+ */
+#ifndef NUBRICK_MAX_IR_CODES
+#define NUBRICK_MAX_IR_CODES            16
+#endif
+
+/** Type of IR data, value of "feature.using_data_type"
+ */
+enum NuBrick_IRDataType {
+    NuBrick_IRDataType_Original     = 0,    // Original (built-in) data, indexed by "feature.index_orig_data_to_send"
+    NuBrick_IRDataType_Learned      = 1,    // Learned data, indexed by "feature.index_learned_data_to_send"
+};
+
+/** A named IR code manager of NuMaker Brick I2C slave module IR
+ *
+ * @note Synchronization level: Thread safe
+ *
+ * @details Feature report of IR is pulled in once and cached. Sending a named code pushes
+ *          feature report only when data type or index differ from cached, and then pushes
+ *          output report with "output.send_IR_flag". Repeatedly sending the same code thus
+ *          takes one bus transfer.
+ *
+ *          The manager assumes it is the only user of the feature/output reports of the IR module.
+ */
+class NuBrickIRCodes {
+
+public:
+
+    /** Create an IR code manager
+     *
+     *  @param ir connected NuBrickMasterIR object
+     */
+    NuBrickIRCodes(NuBrickMasterIR &ir);
+
+    virtual ~NuBrickIRCodes() {
+        // Do nothing
+    }
+    
+    /** Map name to IR code
+     *
+     *  @param name name of the code, must remain valid
+     *  @param index index of the code
+     *  @param data_type type of the code
+     *  @return true if success, false if failure
+     */
+    bool add_code(const char *name, uint16_t index, NuBrick_IRDataType data_type = NuBrick_IRDataType_Learned);
+    
+    /** Send named IR code with the minimum number of bus transfers
+     *
+     *  @return true if success, false if failure or learn() in progress
+     */
+    bool send(const char *name);
+    
+    /** Learn a new IR code and map name to it
+     *
+     *  @param name name of the code, must remain valid
+     *  @param timeout_ms time in ms to wait for IR data received
+     *  @param poll_ms poll interval in ms of "input.received_data_flag"
+     *  @return true if success, false if failure or timeout
+     *
+     *  @note Sets "output.learn_IR_flag", waits for "input.received_data_flag", and maps name to
+     *        the last of "feature.num_learned_data". The wait doesn't hold the lock, so other
+     *        methods don't block on it.
+     */
+    bool learn(const char *name, uint32_t timeout_ms = 10000, uint32_t poll_ms = 50);
+    
+    /** Drop cached feature report, to pull in again on next send
+     */
+    void invalidate(void);
+    
+    /** Get number of bus transfers issued, for comparison of send cost
+     */
+    uint32_t get_num_transfers(void) {
+        return _num_transfers;
+    }
+    
+protected:
+    /** Named IR code
+     */
+    struct Code {
+        const char *                    name;
+        uint16_t                        index;
+        uint8_t                         data_type;
+    };
+    
+    NuBrickMasterIR &                   _ir;
+    const int                           _using_data_type_pos;
+    const int                           _index_orig_data_to_send_pos;
+    const int                           _index_learned_data_to_send_pos;
+    NuBrickField &                      _num_learned_data;
+    NuBrickField &                      _received_data_flag;
+    const int                           _send_IR_flag_pos;
+    const int                           _learn_IR_flag_pos;
+    Code                                _codes[NUBRICK_MAX_IR_CODES];
+    unsigned                            _num_codes;
+    bool                                _cache_valid;
+    uint16_t                            _cache_data_type;
+    uint16_t                            _cache_index;
+    volatile uint32_t                   _num_transfers;
+    bool                                _learning;
+    rtos::Mutex                         _mutex;
+    
+    /** Pull in feature report into cache if not cached yet
+     */
+    bool sync(void);
+    
+    /** Find named IR code
+     */
+    Code *find_code(const char *name);
+    
+    /** Map name to IR code, with the lock held
+     */
+    bool put_code(const char *name, uint16_t index, NuBrick_IRDataType data_type);
+    
+    /** Push output report with send/learn flags
+     */
+    bool push_flags(uint16_t send_flag, uint16_t learn_flag);
+};
+
+#endif
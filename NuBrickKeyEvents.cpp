@@ -0,0 +1,181 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickKeyEvents.h"
+
+/* Thread flag to stop poll thread */
+#define NUBRICK_KEYS_FLAG_STOP          0x1
+
+NuBrickKeyEvents::NuBrickKeyEvents(NuBrickMasterKeys &keys) :
+    _keys(keys), _state(0), _cnt0(0), _cnt1(0), _long_pressed(0),
+    _active_ms(10), _idle_ms(100), _long_press_ms(800), _repeat_ms(200), _num_dropped(0),
+    _events_sem(0, NUBRICK_KEY_EVENT_QUEUE_SIZE), _thread(NULL), _running(false) {
+    
+    // No lock needed in the constructor
+    
+    memset(_press_time, 0x00, sizeof (_press_time));
+}
+
+NuBrickKeyEvents::~NuBrickKeyEvents() {
+    
+    stop();
+}
+
+bool NuBrickKeyEvents::start(uint32_t active_ms, uint32_t idle_ms, uint32_t long_press_ms, uint32_t repeat_ms) {
+    
+    if (_thread) {
+        return true;
+    }
+    if (active_ms == 0 || idle_ms < active_ms || ! _keys.get_field_mask("input.key_state")) {
+        return false;
+    }
+    
+    _active_ms = active_ms;
+    _idle_ms = idle_ms;
+    _long_press_ms = long_press_ms;
+    _repeat_ms = repeat_ms;
+    _state = 0;
+    _cnt0 = _cnt1 = 0;
+    _long_pressed = 0;
+    
+    _running = true;
+    _thread = new rtos::Thread(osPriorityAboveNormal);
+    if (_thread->start(mbed::callback(this, &NuBrickKeyEvents::thread_main)) != osOK) {
+        delete _thread;
+        _thread = NULL;
+        _running = false;
+        return false;
+    }
+    
+    return true;
+}
+
+void NuBrickKeyEvents::stop(void) {
+    
+    if (! _thread) {
+        return;
+    }
+    
+    _running = false;
+    _thread->flags_set(NUBRICK_KEYS_FLAG_STOP);
+    _thread->join();
+    delete _thread;
+    _thread = NULL;
+}
+
+bool NuBrickKeyEvents::get_event(NuBrickKeyEvent &event, uint32_t timeout_ms) {
+    
+    if (! _events_sem.try_acquire_for(std::chrono::milliseconds(timeout_ms))) {
+        return false;
+    }
+    
+    // Support thread-safe
+    _mutex.lock();
+    bool success = _events.pop(event);
+    _mutex.unlock();
+    
+    return success;
+}
+
+bool NuBrickKeyEvents::process_sample(uint16_t sample, uint32_t now_ms) {
+    
+    // Vertical 2-bit counters: a bit of state toggles after 4 consecutive differing samples
+    uint16_t delta = sample ^ _state;
+    _cnt1 = (_cnt1 ^ _cnt0) & delta;
+    _cnt0 = ~_cnt0 & delta;
+    uint16_t toggle = delta & ~(_cnt0 | _cnt1);
+    _state ^= toggle;
+    
+    uint16_t pressed = toggle & _state;
+    uint16_t released = toggle & ~_state;
+    uint16_t held = _state & ~toggle;
+    unsigned key;
+    
+    for (key = 0; key < NUBRICK_NUM_KEYS; key ++) {
+        uint16_t bit = 1 << key;
+        
+        if (pressed & bit) {
+            _press_time[key] = now_ms;
+            _long_pressed &= ~bit;
+            put_event(key, NuBrick_KeyEvent_Press, now_ms);
+        }
+        else if (released & bit) {
+            _long_pressed &= ~bit;
+            put_event(key, NuBrick_KeyEvent_Release, now_ms);
+        }
+        else if (held & bit) {
+            uint32_t held_ms = now_ms - _press_time[key];
+            
+            if (! (_long_pressed & bit)) {
+                if (held_ms >= _long_press_ms) {
+                    _long_pressed |= bit;
+                    _press_time[key] = now_ms;
+                    put_event(key, NuBrick_KeyEvent_LongPress, now_ms);
+                }
+            }
+            else if (_repeat_ms && held_ms >= _repeat_ms) {
+                _press_time[key] = now_ms;
+                put_event(key, NuBrick_KeyEvent_Repeat, now_ms);
+            }
+        }
+    }
+    
+    return _state || delta;
+}
+
+void NuBrickKeyEvents::put_event(unsigned key, NuBrick_KeyEvent type, uint32_t now_ms) {
+    
+    NuBrickKeyEvent event;
+    event.key = key;
+    event.type = type;
+    event.time_ms = now_ms;
+    
+    // Support thread-safe
+    _mutex.lock();
+    
+    if (_events.full()) {
+        _num_dropped ++;
+        _mutex.unlock();
+        return;
+    }
+    _events.push(event);
+    
+    _mutex.unlock();
+    
+    _events_sem.release();
+}
+
+void NuBrickKeyEvents::thread_main(void) {
+    
+    NuBrickField &key_state = _keys["input.key_state"];
+    rtos::Kernel::Clock::time_point next = rtos::Kernel::Clock::now();
+    
+    while (_running) {
+        bool active = false;
+        
+        if (_keys.pull_input_report()) {
+            uint32_t now_ms = (uint32_t) rtos::Kernel::Clock::now().time_since_epoch().count();
+            active = process_sample(key_state.get_value(), now_ms);
+        }
+        
+        // Sample fast only while keys are down or bouncing
+        next += std::chrono::milliseconds(active ? _active_ms : _idle_ms);
+        rtos::Kernel::Clock::time_point now = rtos::Kernel::Clock::now();
+        if (next < now) {
+            next = now;
+        }
+        rtos::ThisThread::flags_wait_any_until(NUBRICK_KEYS_FLAG_STOP, next);
+    }
+}
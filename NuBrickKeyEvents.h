@@ -0,0 +1,138 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_KEY_EVENTS_H
+#define NUBRICK_KEY_EVENTS_H
+
+#include "mbed.h"
+#include "NuBrickMasterKeys.h"
+
+/** Size of key event queue
+ */
+#ifndef NUBRICK_KEY_EVENT_QUEUE_SIZE
+#define NUBRICK_KEY_EVENT_QUEUE_SIZE    16
+#endif
+
+/** Number of keys decoded from "input.key_state"
+ */
+#define NUBRICK_NUM_KEYS                16
+
+/** Type of key event
+ */
+enum NuBrick_KeyEvent {
+    NuBrick_KeyEvent_Press          = 1,    // Key pressed
+    NuBrick_KeyEvent_Release        = 2,    // Key released
+    NuBrick_KeyEvent_LongPress      = 3,    // Key held for long-press time
+    NuBrick_KeyEvent_Repeat         = 4,    // Key still held, every repeat time after long press
+};
+
+/** Key event
+ */
+struct NuBrickKeyEvent {
+    uint8_t     key;                        // Key number, bit position in "input.key_state"
+    uint8_t     type;                       // Type of key event, NuBrick_KeyEvent
+    uint32_t    time_ms;                    // Time of event in ms of kernel clock
+};
+
+/** A debounce and edge-event engine of NuMaker Brick I2C slave module Keys
+ *
+ * @note Synchronization level: Thread safe
+ *
+ * @details A poll thread samples "input.key_state" and debounces all keys at once with
+ *          bitwise vertical counters: a key changes state only after 4 consecutive samples
+ *          agree. Changes are decoded into press, release, long-press and repeat events and
+ *          put in a bounded event queue. Poll rate drops to idle rate when no key is down
+ *          or bouncing.
+ */
+class NuBrickKeyEvents {
+
+public:
+
+    /** Create a key event engine
+     *
+     *  @param keys connected NuBrickMasterKeys object
+     */
+    NuBrickKeyEvents(NuBrickMasterKeys &keys);
+
+    virtual ~NuBrickKeyEvents();
+    
+    /** Start polling keys
+     *
+     *  @param active_ms poll interval in ms while any key is down or bouncing
+     *  @param idle_ms poll interval in ms while no key is down
+     *  @param long_press_ms time in ms a key is held before long-press event
+     *  @param repeat_ms interval in ms of repeat events after long-press event, 0 for no repeat
+     *  @return true if success, false if failure
+     */
+    bool start(uint32_t active_ms = 10, uint32_t idle_ms = 100, uint32_t long_press_ms = 800, uint32_t repeat_ms = 200);
+    
+    /** Stop polling keys
+     */
+    void stop(void);
+    
+    /** Get next key event
+     *
+     *  @param event key event
+     *  @param timeout_ms time in ms to wait for key event, 0 for no wait
+     *  @return true if success, false if no key event within timeout
+     */
+    bool get_event(NuBrickKeyEvent &event, uint32_t timeout_ms = 0);
+    
+    /** Get debounced key state
+     */
+    uint16_t get_key_state(void) {
+        return _state;
+    }
+    
+    /** Get number of key events dropped for queue full
+     */
+    uint32_t get_num_dropped(void) {
+        return _num_dropped;
+    }
+    
+protected:
+    NuBrickMasterKeys &                 _keys;
+    volatile uint16_t                   _state;
+    uint16_t                            _cnt0;
+    uint16_t                            _cnt1;
+    uint16_t                            _long_pressed;
+    uint32_t                            _press_time[NUBRICK_NUM_KEYS];
+    uint32_t                            _active_ms;
+    uint32_t                            _idle_ms;
+    uint32_t                            _long_press_ms;
+    uint32_t                            _repeat_ms;
+    volatile uint32_t                   _num_dropped;
+    mbed::CircularBuffer<NuBrickKeyEvent, NUBRICK_KEY_EVENT_QUEUE_SIZE> _events;
+    rtos::Semaphore                     _events_sem;
+    rtos::Mutex                         _mutex;
+    rtos::Thread *                      _thread;
+    volatile bool                       _running;
+    
+    /** Debounce one sample of "input.key_state" and decode events
+     *
+     *  @return true if any key is down or bouncing
+     */
+    bool process_sample(uint16_t sample, uint32_t now_ms);
+    
+    /** Put key event in queue
+     */
+    void put_event(unsigned key, NuBrick_KeyEvent type, uint32_t now_ms);
+    
+    /** Thread entry of start()
+     */
+    void thread_main(void);
+};
+
+#endif
@@ -0,0 +1,225 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickLEDAnimator.h"
+
+/* Thread flag to stop animation thread */
+#define NUBRICK_LED_FLAG_STOP           0x1
+
+/* Maximum length of one pre-serialized frame */
+#define NUBRICK_LED_FRAME_MAX           80
+
+NuBrickLEDAnimator::NuBrickLEDAnimator(NuBrickMasterLED &led) :
+    _led(led), _frames(NULL), _canon(NULL), _num_frames(0), _frame_len(0), _fps(0), _loop(true),
+    _thread(NULL), _running(false) {
+    
+    // No lock needed in the constructor
+    
+    memset(&_stats, 0x00, sizeof (_stats));
+}
+
+NuBrickLEDAnimator::~NuBrickLEDAnimator() {
+    
+    stop();
+    
+    delete [] _frames;
+    delete [] _canon;
+}
+
+bool NuBrickLEDAnimator::compile(const NuBrickLEDFrame *frames, unsigned num_frames) {
+    
+    if (_running || frames == NULL || num_frames == 0) {
+        return false;
+    }
+    
+    // Reap thread of animation played once
+    stop();
+    
+    const int pos[] = {
+        _led.get_field_position("feature.brightness"),
+        _led.get_field_position("feature.color"),
+        _led.get_field_position("feature.blink"),
+        _led.get_field_position("feature.period"),
+        _led.get_field_position("feature.duty"),
+        _led.get_field_position("feature.latency")
+    };
+    const unsigned num_fields = sizeof (pos) / sizeof (pos[0]);
+    uint16_t values[NUBRICK_MAX_REPORT_FIELDS];
+    uint8_t frame[NUBRICK_LED_FRAME_MAX];
+    unsigned i, j;
+    
+    for (j = 0; j < num_fields; j ++) {
+        if (pos[j] < 0) {
+            return false;
+        }
+    }
+    
+    // Other feature fields take current local values. LED fields vary only in this copy,
+    // so local values seen by other threads are never touched.
+    unsigned num_values = _led.get_feature_values(values, NUBRICK_MAX_REPORT_FIELDS);
+    
+    delete [] _frames;
+    delete [] _canon;
+    _frames = NULL;
+    _canon = new uint16_t[num_frames];
+    _num_frames = 0;
+    _frame_len = 0;
+    
+    bool success = true;
+    for (i = 0; i < num_frames && success; i ++) {
+        const uint16_t frame_values[] = {
+            frames[i].brightness, frames[i].color, frames[i].blink,
+            frames[i].period, frames[i].duty, frames[i].latency
+        };
+        for (j = 0; j < num_fields; j ++) {
+            values[pos[j]] = frame_values[j];
+        }
+        
+        unsigned len = _led.build_feature_frame(values, num_values, frame, sizeof (frame));
+        if (len == 0) {
+            success = false;
+            break;
+        }
+        if (_frames == NULL) {
+            _frame_len = len;
+            _frames = new uint8_t[num_frames * len];
+        }
+        
+        uint8_t *dst = _frames + i * _frame_len;
+        memcpy(dst, frame, _frame_len);
+        
+        // Identical to previous frame joins its run
+        _canon[i] = (i && memcmp(dst - _frame_len, dst, _frame_len) == 0) ? _canon[i - 1] : i;
+    }
+    
+    if (success) {
+        _num_frames = num_frames;
+    }
+    
+    return success;
+}
+
+bool NuBrickLEDAnimator::start(uint32_t fps, bool loop, osPriority priority) {
+    
+    if (_running) {
+        return true;
+    }
+    
+    // Reap thread of animation played once
+    stop();
+    
+    // Frame period in whole us must not be 0
+    if (fps == 0 || fps > 1000000 || _num_frames == 0) {
+        return false;
+    }
+    
+    _mutex.lock();
+    _fps = fps;
+    _loop = loop;
+    memset(&_stats, 0x00, sizeof (_stats));
+    _pace.reset();
+    _mutex.unlock();
+    
+    _running = true;
+    _thread = new rtos::Thread(priority);
+    if (_thread->start(mbed::callback(this, &NuBrickLEDAnimator::thread_main)) != osOK) {
+        delete _thread;
+        _thread = NULL;
+        _running = false;
+        return false;
+    }
+    
+    return true;
+}
+
+void NuBrickLEDAnimator::stop(void) {
+    
+    if (! _thread) {
+        return;
+    }
+    
+    _running = false;
+    _thread->flags_set(NUBRICK_LED_FLAG_STOP);
+    _thread->join();
+    delete _thread;
+    _thread = NULL;
+}
+
+void NuBrickLEDAnimator::get_stats(NuBrickAnimationStats &stats) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    stats = _stats;
+    stats.jitter_mean = _pace.get_jitter_mean();
+    stats.jitter_max = _pace.get_jitter_max();
+    
+    _mutex.unlock();
+}
+
+void NuBrickLEDAnimator::thread_main(void) {
+    
+    uint32_t frame_us = 1000000 / _fps;
+    NuBrickPacer pacer;
+    uint64_t slot = 0;
+    int last_canon = -1;
+    
+    pacer.start();
+    while (_running) {
+        uint64_t offset_us = slot * frame_us;
+        pacer.wait_until(offset_us, NUBRICK_LED_FLAG_STOP);
+        if (! _running) {
+            break;
+        }
+        
+        uint64_t now_us = pacer.elapsed_us();
+        int64_t lateness = (int64_t) now_us - (int64_t) offset_us;
+        uint32_t jitter = NuBrickPacer::abs_us(lateness);
+        
+        // Drop frames we are late for by whole frame periods
+        uint32_t num_dropped = (lateness > 0) ? (uint32_t) (lateness / frame_us) : 0;
+        slot += num_dropped;
+        
+        if (! _loop && slot >= _num_frames) {
+            break;
+        }
+        unsigned index = slot % _num_frames;
+        
+        // Skip frame identical to the previously pushed one
+        bool skipped = (_canon[index] == last_canon);
+        bool success = true;
+        if (! skipped) {
+            success = _led.push_frame(_frames + index * _frame_len, _frame_len);
+            last_canon = success ? _canon[index] : -1;
+        }
+        
+        _mutex.lock();
+        _stats.frames_dropped += num_dropped;
+        if (skipped) {
+            _stats.frames_skipped ++;
+        }
+        else if (success) {
+            _stats.frames_pushed ++;
+        }
+        else {
+            _stats.push_failures ++;
+        }
+        _pace.add(now_us, jitter);
+        _mutex.unlock();
+        
+        slot ++;
+    }
+    
+    _running = false;
+}
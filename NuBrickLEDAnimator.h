@@ -0,0 +1,119 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_LED_ANIMATOR_H
+#define NUBRICK_LED_ANIMATOR_H
+
+#include "mbed.h"
+#include "NuBrickMasterLED.h"
+#include "NuBrickPacer.h"
+
+/** One frame of LED animation, values of LED feature report fields
+ */
+struct NuBrickLEDFrame {
+    uint16_t    brightness;                 // "feature.brightness"
+    uint16_t    color;                      // "feature.color"
+    uint16_t    blink;                      // "feature.blink"
+    uint16_t    period;                     // "feature.period"
+    uint16_t    duty;                       // "feature.duty"
+    uint16_t    latency;                    // "feature.latency"
+};
+
+/** Statistics of LED animation
+ */
+struct NuBrickAnimationStats {
+    uint32_t    frames_pushed;              // Number of frames pushed
+    uint32_t    frames_skipped;             // Number of frames skipped for identical to the previous one
+    uint32_t    frames_dropped;             // Number of frames dropped for running late
+    uint32_t    push_failures;              // Number of frames failed to push
+    uint32_t    jitter_mean;                // Mean lateness of frame against schedule in us
+    uint32_t    jitter_max;                 // Maximum lateness of frame against schedule in us
+};
+
+/** An animation engine of NuMaker Brick I2C slave module LED
+ *
+ * @note Synchronization level: Thread safe
+ *
+ * @details An animation is compiled once into pre-serialized feature report frames. A thread
+ *          then pushes them as is at fixed frame rate. Frames identical to the previously
+ *          pushed one are skipped. When running late by a whole frame period or more, frames
+ *          are dropped to catch up.
+ */
+class NuBrickLEDAnimator {
+
+public:
+
+    /** Create an LED animation engine
+     *
+     *  @param led connected NuBrickMasterLED object
+     */
+    NuBrickLEDAnimator(NuBrickMasterLED &led);
+
+    virtual ~NuBrickLEDAnimator();
+    
+    /** Compile animation into pre-serialized frames
+     *
+     *  @param frames frames of the animation
+     *  @param num_frames number of frames
+     *  @return true if success, false if failure
+     *
+     *  @note Other feature fields, e.g. "feature.sleep_period", take current local values.
+     *        Local values themselves are left untouched.
+     */
+    bool compile(const NuBrickLEDFrame *frames, unsigned num_frames);
+    
+    /** Start animation
+     *
+     *  @param fps frame rate in frames per second, 1~1000000 so a frame lasts at least 1 us
+     *  @param loop true to loop the animation, false to play once
+     *  @param priority priority of the animation thread
+     *  @return true if success, false if failure
+     */
+    bool start(uint32_t fps, bool loop = true, osPriority priority = osPriorityAboveNormal);
+    
+    /** Stop animation
+     */
+    void stop(void);
+    
+    /** Is animation playing?
+     */
+    bool playing(void) {
+        return _running;
+    }
+    
+    /** Get statistics of animation
+     */
+    void get_stats(NuBrickAnimationStats &stats);
+    
+protected:
+    NuBrickMasterLED &                  _led;
+    uint8_t *                           _frames;
+    uint16_t *                          _canon;     // Index of first frame of run of identical frames
+    unsigned                            _num_frames;
+    unsigned                            _frame_len;
+    uint32_t                            _fps;
+    bool                                _loop;
+    NuBrickAnimationStats               _stats;
+    NuBrickPaceStats                    _pace;
+    rtos::Mutex                         _mutex;
+    rtos::Thread *                      _thread;
+    volatile bool                       _running;
+    
+    /** Thread entry of start()
+     */
+    void thread_main(void);
+};
+
+#endif
@@ -0,0 +1,153 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickLog.h"
+#include "hal/us_ticker_api.h"
+#include <cstring>
+
+/* Thread flags of draining thread */
+#define NUBRICK_LOG_FLAG_STOP           0x1
+
+NuBrickLog::Entry NuBrickLog::_entries[NUBRICK_LOG_QUEUE_SIZE];
+volatile uint32_t NuBrickLog::_head = 0;
+volatile uint32_t NuBrickLog::_tail = 0;
+volatile uint32_t NuBrickLog::_num_dropped = 0;
+rtos::Thread *NuBrickLog::_thread = NULL;
+
+void NuBrickLog::post(int i2c_addr, NuBrickError code, const char *name, const char *fmt,
+    int32_t a0, int32_t a1, int32_t a2) {
+    
+    uint32_t head = _head;
+    uint32_t tail = core_util_atomic_load_u32(&_tail);
+    
+    if ((head - tail) >= NUBRICK_LOG_QUEUE_SIZE) {
+        _num_dropped = _num_dropped + 1;
+        return;
+    }
+    
+    Entry &entry = _entries[head % NUBRICK_LOG_QUEUE_SIZE];
+    entry.fmt = fmt;
+    entry.args[0] = a0;
+    entry.args[1] = a1;
+    entry.args[2] = a2;
+    entry.timestamp = us_ticker_read();
+    entry.i2c_addr = (uint8_t) i2c_addr;
+    entry.code = (uint8_t) code;
+    entry.has_name = (name != NULL);
+    if (name) {
+        strncpy(entry.name, name, NUBRICK_LOG_NAME_SIZE - 1);
+        entry.name[NUBRICK_LOG_NAME_SIZE - 1] = '\0';
+    }
+    
+    // Publish entry after it is filled
+    core_util_atomic_store_u32(&_head, head + 1);
+}
+
+unsigned NuBrickLog::drain(void) {
+    
+    unsigned num = 0;
+    uint32_t tail = _tail;
+    
+    while (tail != core_util_atomic_load_u32(&_head)) {
+        const Entry &entry = _entries[tail % NUBRICK_LOG_QUEUE_SIZE];
+        
+        printf("[%lu] NuBrick 0x%02x: %s: ", (unsigned long) entry.timestamp, entry.i2c_addr,
+            error_string((NuBrickError) entry.code));
+        if (entry.has_name) {
+            printf(entry.fmt, entry.name, entry.args[0], entry.args[1], entry.args[2]);
+        }
+        else {
+            printf(entry.fmt, entry.args[0], entry.args[1], entry.args[2]);
+        }
+        
+        // Release entry after it is consumed
+        core_util_atomic_store_u32(&_tail, ++ tail);
+        num ++;
+    }
+    
+    return num;
+}
+
+bool NuBrickLog::start(osPriority priority) {
+    
+    if (_thread) {
+        return true;
+    }
+    
+    _thread = new rtos::Thread(priority);
+    if (_thread->start(mbed::callback(&NuBrickLog::thread_main)) != osOK) {
+        delete _thread;
+        _thread = NULL;
+        return false;
+    }
+    
+    return true;
+}
+
+void NuBrickLog::stop(void) {
+    
+    if (! _thread) {
+        return;
+    }
+    
+    _thread->flags_set(NUBRICK_LOG_FLAG_STOP);
+    _thread->join();
+    delete _thread;
+    _thread = NULL;
+}
+
+uint32_t NuBrickLog::get_num_dropped(void) {
+    
+    return _num_dropped;
+}
+
+const char *NuBrickLog::error_string(NuBrickError code) {
+    
+    switch (code) {
+        case NuBrick_Error_None:                return "no error";
+        case NuBrick_Error_NotConnected:        return "not connected";
+        case NuBrick_Error_InvalidArgument:     return "invalid argument";
+        case NuBrick_Error_NoResource:          return "no resource";
+        case NuBrick_Error_FieldNotFound:       return "field not found";
+        case NuBrick_Error_BusWrite:            return "bus write NAK";
+        case NuBrick_Error_BusRead:             return "bus read NAK";
+        case NuBrick_Error_LengthMismatch:      return "length mismatch";
+        case NuBrick_Error_DescType:            return "unexpected descriptor type";
+        case NuBrick_Error_FieldIndex:          return "field index mismatch";
+        case NuBrick_Error_FieldLength:         return "bad field length";
+        case NuBrick_Error_FieldRange:          return "bad field range";
+        case NuBrick_Error_BufferOverflow:      return "buffer overflow";
+        case NuBrick_Error_Degraded:            return "degraded";
+        case NuBrick_Error_DeviceChanged:       return "device changed";
+        case NuBrick_Error_Cancelled:           return "cancelled";
+    }
+    
+    return "unknown error";
+}
+
+void NuBrickLog::thread_main(void) {
+    
+    while (true) {
+        drain();
+        
+        if (rtos::ThisThread::flags_wait_any_for(NUBRICK_LOG_FLAG_STOP, std::chrono::milliseconds(NUBRICK_LOG_DRAIN_INTERVAL))
+            == NUBRICK_LOG_FLAG_STOP) {
+            break;
+        }
+    }
+    
+    // Flush
+    drain();
+}
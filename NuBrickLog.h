@@ -0,0 +1,135 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_LOG_H
+#define NUBRICK_LOG_H
+
+#include "mbed.h"
+
+/** Number of entries of deferred log queue
+ */
+#ifndef NUBRICK_LOG_QUEUE_SIZE
+#define NUBRICK_LOG_QUEUE_SIZE          16
+#endif
+
+/** Size of name copied into deferred log entry, null terminator included
+ */
+#ifndef NUBRICK_LOG_NAME_SIZE
+#define NUBRICK_LOG_NAME_SIZE           24
+#endif
+
+/** Drain interval of deferred log queue in ms
+ */
+#ifndef NUBRICK_LOG_DRAIN_INTERVAL
+#define NUBRICK_LOG_DRAIN_INTERVAL      50
+#endif
+
+/** Structured error code of NuBrickMaster
+ */
+enum NuBrickError {
+    NuBrick_Error_None              = 0,
+    NuBrick_Error_NotConnected,             // NuMaker Brick I2C slave module not connected yet
+    NuBrick_Error_InvalidArgument,          // Invalid argument, e.g. NULL callback or bad handle
+    NuBrick_Error_NoResource,               // No free slot, e.g. subscription or observer
+    NuBrick_Error_FieldNotFound,            // No such report field
+    NuBrick_Error_BusWrite,                 // I2C write NAK
+    NuBrick_Error_BusRead,                  // I2C read NAK
+    NuBrick_Error_LengthMismatch,           // Length of descriptor/report doesn't match
+    NuBrick_Error_DescType,                 // Unexpected report descriptor type
+    NuBrick_Error_FieldIndex,               // Field index of report descriptor doesn't match
+    NuBrick_Error_FieldLength,              // Field length other than 1/2
+    NuBrick_Error_FieldRange,               // Bad field minimum/maximum item of report descriptor
+    NuBrick_Error_BufferOverflow,           // Buffer too small
+    NuBrick_Error_Degraded,                 // Brick degraded for consecutive failures, see NuBrickMaster::probe()
+    NuBrick_Error_DeviceChanged,            // Device descriptor changed across probe
+    NuBrick_Error_Cancelled,                // Request cancelled before executed
+};
+
+/** A deferred, lock-free log queue of NuBrickMaster error messages
+ *
+ * @note Synchronization level: Thread safe
+ *
+ * @details post() only copies format string pointer, integer arguments, and a short name into
+ *          the queue. Formatting and printing happen in drain(), called by a low-priority
+ *          thread started with start(), so that the NuBrickMaster lock never waits on string
+ *          formatting or the UART. Messages are dropped when the queue is full.
+ *
+ *          post() is single-producer: it's called with the NuBrickMaster lock held.
+ */
+class NuBrickLog {
+
+public:
+
+    /** Post one message to deferred log queue
+     *
+     *  @param i2c_addr 8-bit I2C slave address of brick
+     *  @param code error code
+     *  @param name name copied with message, e.g. field name, or NULL. Passed as the first
+     *         argument of fmt, before a0~a2, if not NULL.
+     *  @param fmt format string, must be a string literal
+     *  @param a0~a2 integer arguments of fmt
+     */
+    static void post(int i2c_addr, NuBrickError code, const char *name, const char *fmt,
+        int32_t a0 = 0, int32_t a1 = 0, int32_t a2 = 0);
+    
+    /** Format and print queued messages
+     *
+     *  @return number of messages printed
+     */
+    static unsigned drain(void);
+    
+    /** Start low-priority thread draining deferred log queue
+     *
+     *  @return true if success, false if failure
+     */
+    static bool start(osPriority priority = osPriorityLow);
+    
+    /** Stop draining thread
+     */
+    static void stop(void);
+    
+    /** Get number of messages dropped for queue full
+     */
+    static uint32_t get_num_dropped(void);
+    
+    /** Get short description of error code
+     */
+    static const char *error_string(NuBrickError code);
+    
+protected:
+    /** Deferred log entry
+     */
+    struct Entry {
+        const char *                    fmt;
+        int32_t                         args[3];
+        uint32_t                        timestamp;
+        uint8_t                         i2c_addr;
+        uint8_t                         code;
+        bool                            has_name;
+        char                            name[NUBRICK_LOG_NAME_SIZE];
+    };
+    
+    static Entry                        _entries[NUBRICK_LOG_QUEUE_SIZE];
+    static volatile uint32_t            _head;      // Written by producer only
+    static volatile uint32_t            _tail;      // Written by consumer only
+    static volatile uint32_t            _num_dropped;
+    static rtos::Thread *               _thread;
+    
+    /** Thread entry of start()
+     */
+    static void thread_main(void);
+};
+
+#endif
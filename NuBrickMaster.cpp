@@ -15,16 +15,32 @@
  */
 #include "NuBrickMaster.h"
 #include <cstring>
+#include "hal/us_ticker_api.h"
 
 SingletonPtr<rtos::Mutex> NuBrickMaster::_mutex;
 
+#if NUBRICK_LOCK_TRACE
+unsigned NuBrickMaster::_lock_depth = 0;
+uint32_t NuBrickMaster::_lock_start = 0;
+uint32_t NuBrickMaster::_lock_wait = 0;
+const NuBrickMaster *NuBrickMaster::_lock_master = NULL;
+int NuBrickMaster::_lock_i2c_addr = 0;
+const char *NuBrickMaster::_lock_method = NULL;
+NuBrickLockStats NuBrickMaster::_lock_stats;
+#endif
+
 NuBrickMaster::NuBrickMaster(I2C &i2c, int i2c_addr, bool debug)
     : _i2c(i2c), _i2c_addr(i2c_addr), 
-        _i2c_buf_pos(_i2c_buf), _i2c_buf_end(_i2c_buf + sizeof (_i2c_buf) / sizeof (_i2c_buf[0])), _i2c_buf_overflow(false),
-        _connected(false), _debug(debug), _null_field(0, ""),
+        _transport(NULL), _recorder(NULL), _trace(NULL), _mux(NULL), _mux_channel(-1),
+        _connected(false), _debug(debug), _last_error(NuBrick_Error_None),
+        _health(NuBrick_Health_Healthy), _degrade_threshold(NUBRICK_DEGRADE_THRESHOLD), _consecutive_failures(0), _null_field(0, ""),
         _feature_report_fields(NULL), _num_feature_report_fields(0), 
         _input_report_fields(NULL), _num_input_report_fields(0),
-        _output_report_fields(NULL), _num_output_report_fields(0) {
+        _output_report_fields(NULL), _num_output_report_fields(0),
+        _input_report_prev_valid(false), _input_pulled_mask(0), _input_changed_mask(0), _input_alarm_mask(0),
+        _poll_interval_min(NUBRICK_POLL_INTERVAL_DEFAULT), _poll_interval_max(NUBRICK_POLL_INTERVAL_DEFAULT),
+        _poll_interval(NUBRICK_POLL_INTERVAL_DEFAULT), _poll_interval_meas(0),
+        _txn_seq(0), _input_published_seq(0), _feature_published_seq(0), _layout_seq(0) {
         
     // No lock needed in the constructor
 
@@ -32,6 +48,13 @@ NuBrickMaster::NuBrickMaster(I2C &i2c, int i2c_addr, bool debug)
     _i2c.frequency(100000);
     
     memset(_i2c_buf, 0x00, sizeof (_i2c_buf));
+    memset(_input_report_prev, 0x00, sizeof (_input_report_prev));
+    memset(&_txn_stats, 0x00, sizeof (_txn_stats));
+    
+    unsigned i;
+    for (i = 0; i < NUBRICK_MAX_SUBSCRIPTIONS; i ++) {
+        _subscriptions[i].used = false;
+    }
 }
 
 NuBrickMaster::~NuBrickMaster() {
@@ -44,293 +67,1553 @@ NuBrickMaster::~NuBrickMaster() {
     remove_output_fields();
 }
     
-bool NuBrickMaster::connect(void) {
-    // Support thread-safe
-    MutexGuard guard;
+bool NuBrickMaster::connect(void) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (_connected) {
+        return true;
+    }
+    
+    // Get device descriptor
+    if (! pull_device_desc()) {
+        _connected = false;
+        NUBRICK_ERROR_RETURN_FALSE(_last_error, "pull_device_desc() failed\r\n");
+    }
+    // Get report descriptor
+    if (! pull_report_desc()) {
+        _connected = false;
+        NUBRICK_ERROR_RETURN_FALSE(_last_error, "pull_report_desc() failed\r\n");
+    }
+    
+    _connected = true;
+    
+    // Health is owned by the lock, already held
+    _health = NuBrick_Health_Healthy;
+    _consecutive_failures = 0;
+    
+    return true;
+}
+
+NuBrickField &NuBrickMaster::operator[](const char *report_field_name) {
+    
+    // No lock needed: fields are fixed once constructed
+    NuBrickField *field = lookup_field(report_field_name);
+    if (field == NULL) {
+        return _null_field;
+    }
+    
+    return *field;
+}
+
+int NuBrickMaster::subscribe(const char *report_field_name, FieldCallback cb, uint16_t deadband) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (! cb) {
+        record_error(NuBrick_Error_InvalidArgument, NULL, "NULL callback not support\r\n");
+        return -1;
+    }
+    
+    return add_subscription(report_field_name, cb, NULL, 0, deadband);
+}
+
+int NuBrickMaster::subscribe(const char *report_field_name, osThreadId_t thread_id, uint32_t flags, uint16_t deadband) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (thread_id == NULL || flags == 0) {
+        record_error(NuBrick_Error_InvalidArgument, NULL, "NULL thread or zero flags not support\r\n");
+        return -1;
+    }
+    
+    return add_subscription(report_field_name, FieldCallback(), thread_id, flags, deadband);
+}
+
+bool NuBrickMaster::unsubscribe(int handle) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (handle < 0 || handle >= NUBRICK_MAX_SUBSCRIPTIONS || ! _subscriptions[handle].used) {
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_InvalidArgument, "Invalid subscription handle %d\r\n", handle);
+    }
+    
+    _subscriptions[handle].cb = FieldCallback();
+    _subscriptions[handle].used = false;
+    
+    return true;
+}
+
+int NuBrickMaster::add_input_observer(ReportCallback cb) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (! cb) {
+        record_error(NuBrick_Error_InvalidArgument, NULL, "NULL callback not support\r\n");
+        return -1;
+    }
+    
+    int handle;
+    for (handle = 0; handle < NUBRICK_MAX_INPUT_OBSERVERS; handle ++) {
+        if (! _input_observers[handle]) {
+            _input_observers[handle] = cb;
+            return handle;
+        }
+    }
+    
+    record_error(NuBrick_Error_NoResource, NULL, "No free input observer\r\n");
+    return -1;
+}
+
+bool NuBrickMaster::remove_input_observer(int handle) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (handle < 0 || handle >= NUBRICK_MAX_INPUT_OBSERVERS || ! _input_observers[handle]) {
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_InvalidArgument, "Invalid input observer handle %d\r\n", handle);
+    }
+    
+    _input_observers[handle] = ReportCallback();
+    
+    return true;
+}
+
+unsigned NuBrickMaster::get_input_values(uint16_t *values, unsigned max_values) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    unsigned i;
+    for (i = 0; i < _num_input_report_fields && i < max_values; i ++) {
+        values[i] = _input_report_fields[i]._value;
+    }
+    
+    return i;
+}
+
+unsigned NuBrickMaster::get_feature_values(uint16_t *values, unsigned max_values) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    unsigned i;
+    for (i = 0; i < _num_feature_report_fields && i < max_values; i ++) {
+        values[i] = _feature_report_fields[i]._value;
+    }
+    
+    return i;
+}
+
+unsigned NuBrickMaster::get_output_values(uint16_t *values, unsigned max_values) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    unsigned i;
+    for (i = 0; i < _num_output_report_fields && i < max_values; i ++) {
+        values[i] = _output_report_fields[i]._value;
+    }
+    
+    return i;
+}
+
+void NuBrickMaster::set_feature_values(const uint16_t *values, unsigned num_values, uint32_t field_mask) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    unsigned i;
+    for (i = 0; i < _num_feature_report_fields && i < num_values; i ++) {
+        if (field_mask & (1UL << i)) {
+            _feature_report_fields[i]._value = values[i];
+        }
+    }
+}
+
+void NuBrickMaster::set_output_values(const uint16_t *values, unsigned num_values, uint32_t field_mask) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    unsigned i;
+    for (i = 0; i < _num_output_report_fields && i < num_values; i ++) {
+        if (field_mask & (1UL << i)) {
+            _output_report_fields[i]._value = values[i];
+        }
+    }
+}
+
+uint32_t NuBrickMaster::get_input_changed_mask(void) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    return _input_changed_mask;
+}
+
+uint32_t NuBrickMaster::get_field_mask(const char *report_field_name) {
+    
+    int pos = get_field_position(report_field_name);
+    
+    return (pos < 0) ? 0 : (1UL << pos);
+}
+
+int NuBrickMaster::get_field_position(const char *report_field_name) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    NuBrickField *field = lookup_field(report_field_name);
+    if (field == NULL) {
+        return -1;
+    }
+    
+    if (field >= _feature_report_fields && field < (_feature_report_fields + _num_feature_report_fields)) {
+        return field - _feature_report_fields;
+    }
+    else if (field >= _input_report_fields && field < (_input_report_fields + _num_input_report_fields)) {
+        return field - _input_report_fields;
+    }
+    else {
+        return field - _output_report_fields;
+    }
+}
+    
+bool NuBrickMaster::pull_device_desc(void) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    // Send GetDeviceDescriptor command and receive device descriptor
+    NuBrickError error = transfer_read(NuBrick_Comm_GetDeviceDesc, _i2c_buf, NuBrick_DeviceDesc_Len);
+    if (error) {
+        NUBRICK_ERROR_RETURN_FALSE(error, "i2c transfer failed\r\n");
+    }
+    
+    // Pulls decoding on the old layout out of the lock must not publish
+    _layout_seq ++;
+    
+    // Un-serialize device descriptor
+    NuBrickCursor cursor(_i2c_buf, NuBrick_DeviceDesc_Len);
+    if (! unserialize_device_desc(cursor)) {
+        NUBRICK_ERROR_RETURN_FALSE(_last_error, "unserialize_device_desc() failed\r\n");
+    }
+    
+    return true;
+}
+
+bool NuBrickMaster::pull_report_desc(void) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    // Send GetReportDescriptor command and receive report descriptor
+    NuBrickError error = transfer_read(NuBrick_Comm_GetReportDesc, _i2c_buf, _dev_desc.report_desc_len);
+    if (error) {
+        NUBRICK_ERROR_RETURN_FALSE(error, "i2c transfer failed\r\n");
+    }
+    
+    // Pulls decoding on the old layout out of the lock must not publish
+    _layout_seq ++;
+    
+    // Un-serialize report descriptor
+    NuBrickCursor cursor(_i2c_buf, _dev_desc.report_desc_len);
+    if (! unserialize_report_desc(cursor)) {
+        NUBRICK_ERROR_RETURN_FALSE(_last_error, "unserialize_report_desc() failed\r\n");
+    }
+    
+    return true;
+}
+    
+bool NuBrickMaster::pull_input_report(void) {
+    
+    NuBrickError error;
+    
+    return pull_input_report(error);
+}
+
+bool NuBrickMaster::pull_input_report(NuBrickError &error) {
+    
+    uint8_t report[sizeof (_i2c_buf)];
+    uint16_t values[NUBRICK_MAX_REPORT_FIELDS];
+    uint8_t lengths[NUBRICK_MAX_REPORT_FIELDS];
+    uint16_t report_len;
+    uint32_t seq;
+    uint32_t layout_seq;
+    
+    {
+        // Support thread-safe
+        MutexGuard guard(this, __func__);
+        
+        error = check_ready();
+        if (error) {
+            return false;
+        }
+        
+        report_len = _dev_desc.input_report_len;
+        
+        // Decode on the layout of this moment, probe() may re-pull it meanwhile
+        get_field_lengths(_input_report_fields, _num_input_report_fields, lengths);
+        layout_seq = _layout_seq;
+    }
+    
+    // Only the raw transaction holds the bus lock
+    error = transfer_read(NuBrick_Comm_GetInputReport, report, report_len, &seq);
+    
+    // Decode on private copy, with no lock
+    if (! error) {
+        error = decode_report(report, report_len, report_len, lengths, _num_input_report_fields, values);
+    }
+    
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (error) {
+        NUBRICK_ERROR_RETURN_FALSE(error, "pull_input_report() failed\r\n");
+    }
+    
+    // Layout changed, or concurrent pull of a newer report has published already. Don't publish this one.
+    if (layout_seq != _layout_seq || ! publish_seq(seq, _input_published_seq)) {
+        return true;
+    }
+    
+    // Publish decoded values at once
+    publish_input_report(report, report_len, values);
+    
+    // Notify subscribers of changed fields
+    notify_subscribers();
+    
+    return true;
+}
+
+bool NuBrickMaster::pull_input_fields(uint32_t field_mask) {
+    
+    uint8_t report[sizeof (_i2c_buf)];
+    uint16_t values[NUBRICK_MAX_REPORT_FIELDS];
+    uint8_t lengths[NUBRICK_MAX_REPORT_FIELDS];
+    uint16_t report_len;
+    uint16_t read_len;
+    unsigned num_fields;
+    uint32_t seq;
+    uint32_t layout_seq;
+    
+    {
+        // Support thread-safe
+        MutexGuard guard(this, __func__);
+        
+        NUBRICK_CHECK_CONNECT();
+        NUBRICK_CHECK_HEALTHY();
+        
+        // Read up to the last requested field only
+        read_len = 2;
+        num_fields = 0;
+        unsigned i;
+        for (i = 0; i < _num_input_report_fields; i ++) {
+            if ((field_mask >> i) == 0) {
+                break;
+            }
+            read_len += _input_report_fields[i]._length;
+            num_fields ++;
+        }
+        if (field_mask == 0 || (num_fields < 32 && (field_mask >> num_fields))) {
+            NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_InvalidArgument, "Invalid input field mask 0x%08x\r\n", field_mask);
+        }
+        
+        report_len = _dev_desc.input_report_len;
+        
+        // Decode on the layout of this moment, probe() may re-pull it meanwhile
+        get_field_lengths(_input_report_fields, num_fields, lengths);
+        layout_seq = _layout_seq;
+    }
+    
+    // Only the raw transaction holds the bus lock. Stop condition after read_len ends the read early.
+    NuBrickError error = transfer_read(NuBrick_Comm_GetInputReport, report, read_len, &seq);
+    
+    // Decode on private copy, with no lock
+    if (! error) {
+        error = decode_report(report, report_len, read_len, lengths, num_fields, values);
+    }
+    
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (error) {
+        NUBRICK_ERROR_RETURN_FALSE(error, "pull_input_fields() failed\r\n");
+    }
+    
+    // Layout changed, or concurrent pull of a newer report has published already. Don't publish this one.
+    if (layout_seq != _layout_seq || ! publish_seq(seq, _input_published_seq)) {
+        return true;
+    }
+    
+    // Publish requested fields only
+    publish_input_fields(report, field_mask, num_fields, values);
+    
+    // Notify subscribers of changed fields
+    notify_subscribers();
+    
+    return true;
+}
+
+bool NuBrickMaster::set_adaptive_poll(uint32_t min_interval_ms, uint32_t max_interval_ms) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (min_interval_ms == 0 || min_interval_ms > max_interval_ms) {
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_InvalidArgument, "Invalid poll interval %d/%d\r\n", min_interval_ms, max_interval_ms);
+    }
+    
+    _poll_interval_min = min_interval_ms;
+    _poll_interval_max = max_interval_ms;
+    _poll_interval = min_interval_ms;
+    
+    return true;
+}
+
+bool NuBrickMaster::pull_input_report_adaptive(void) {
+    
+    {
+        // Support thread-safe
+        MutexGuard guard(this, __func__);
+        
+        // Measure effective poll interval
+        rtos::Kernel::Clock::time_point now = rtos::Kernel::Clock::now();
+        if (_poll_interval_meas == 0) {
+            _poll_interval_meas = _poll_interval;
+        }
+        else {
+            int32_t interval = (now - _poll_last).count();
+            _poll_interval_meas += (interval - (int32_t) _poll_interval_meas) / 8;
+        }
+        _poll_last = now;
+    }
+    
+    // Not holding the lock across the transfer
+    if (! pull_input_report()) {
+        return false;
+    }
+    
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    // Check over flags set
+    bool alarm = false;
+    unsigned i;
+    for (i = 0; i < _num_input_report_fields; i ++) {
+        if ((_input_alarm_mask & (1UL << i)) && _input_report_fields[i]._value) {
+            alarm = true;
+            break;
+        }
+    }
+    
+    if (alarm) {
+        _poll_interval = _poll_interval_min;
+    }
+    else if (_input_changed_mask) {
+        _poll_interval = (_poll_interval / 2 > _poll_interval_min) ? (_poll_interval / 2) : _poll_interval_min;
+    }
+    else {
+        _poll_interval = (_poll_interval * 2 < _poll_interval_max) ? (_poll_interval * 2) : _poll_interval_max;
+    }
+    
+    return true;
+}
+
+uint32_t NuBrickMaster::get_poll_interval(void) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    return _poll_interval;
+}
+
+uint32_t NuBrickMaster::get_poll_rate(void) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    uint32_t interval = _poll_interval_meas ? _poll_interval_meas : _poll_interval;
+    return 1000000 / interval;
+}
+
+NuBrick_Health NuBrickMaster::get_health(void) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    return _health;
+}
+
+bool NuBrickMaster::set_degrade_threshold(unsigned threshold) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (threshold == 0) {
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_InvalidArgument, "Zero degrade threshold not support\r\n");
+    }
+    
+    _degrade_threshold = threshold;
+    
+    return true;
+}
+
+bool NuBrickMaster::probe(void) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    NUBRICK_CHECK_CONNECT();
+    
+    NuBrick_Device_Descriptor dev_desc = _dev_desc;
+    
+    // Cheap probe first: device descriptor is short
+    if (! pull_device_desc()) {
+        _dev_desc = dev_desc;
+        NUBRICK_ERROR_RETURN_FALSE(_last_error, "pull_device_desc() failed\r\n");
+    }
+    
+    // Must be the same module as on connect()
+    if (memcmp(&dev_desc, &_dev_desc, sizeof (dev_desc))) {
+        _dev_desc = dev_desc;
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_DeviceChanged, "Device descriptor changed\r\n");
+    }
+    
+    // Revalidate fields against report descriptor
+    if (! pull_report_desc()) {
+        NUBRICK_ERROR_RETURN_FALSE(_last_error, "pull_report_desc() failed\r\n");
+    }
+    
+    // Health is owned by the lock, already held
+    _health = NuBrick_Health_Healthy;
+    _consecutive_failures = 0;
+    _input_report_prev_valid = false;
+    
+    return true;
+}
+
+void NuBrickMaster::get_transaction_stats(NuBrickTransactionStats &stats, bool reset) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    stats = _txn_stats;
+    if (reset) {
+        memset(&_txn_stats, 0x00, sizeof (_txn_stats));
+    }
+}
+
+void NuBrickMaster::reset_transaction_stats(void) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    memset(&_txn_stats, 0x00, sizeof (_txn_stats));
+}
+
+bool NuBrickMaster::push_output_report(void) {
+    
+    NuBrickError error;
+    
+    return push_output_report(error);
+}
+
+bool NuBrickMaster::push_output_report(NuBrickError &error) {
+    
+    uint8_t frame[sizeof (_i2c_buf)];
+    
+    // Serialize under the lock, then push with only the bus lock
+    unsigned length = build_output_frame(NULL, 0, frame, sizeof (frame), error);
+    if (length == 0) {
+        return false;
+    }
+    
+    return push_frame(frame, length, error);
+}
+    
+bool NuBrickMaster::pull_feature_report(void) {
+    
+    NuBrickError error;
+    
+    return pull_feature_report(error);
+}
+
+bool NuBrickMaster::pull_feature_report(NuBrickError &error) {
+    
+    uint8_t report[sizeof (_i2c_buf)];
+    uint16_t values[NUBRICK_MAX_REPORT_FIELDS];
+    uint8_t lengths[NUBRICK_MAX_REPORT_FIELDS];
+    uint16_t report_len;
+    uint32_t seq;
+    uint32_t layout_seq;
+    
+    {
+        // Support thread-safe
+        MutexGuard guard(this, __func__);
+        
+        error = check_ready();
+        if (error) {
+            return false;
+        }
+        
+        report_len = _dev_desc.getfeat_report_len;
+        
+        // Decode on the layout of this moment, probe() may re-pull it meanwhile
+        get_field_lengths(_feature_report_fields, _num_feature_report_fields, lengths);
+        layout_seq = _layout_seq;
+    }
+    
+    // Only the raw transaction holds the bus lock
+    error = transfer_read(NuBrick_Comm_GetFeatureReport, report, report_len, &seq);
+    
+    // Decode on private copy, with no lock
+    if (! error) {
+        error = decode_report(report, report_len, report_len, lengths, _num_feature_report_fields, values);
+    }
+    
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (error) {
+        NUBRICK_ERROR_RETURN_FALSE(error, "pull_feature_report() failed\r\n");
+    }
+    
+    // Layout changed, or concurrent pull of a newer report has published already. Don't publish this one.
+    if (layout_seq != _layout_seq || ! publish_seq(seq, _feature_published_seq)) {
+        return true;
+    }
+    
+    // Publish decoded values at once
+    unsigned i;
+    for (i = 0; i < _num_feature_report_fields; i ++) {
+        _feature_report_fields[i]._value = values[i];
+    }
+    
+    return true;
+}
+
+bool NuBrickMaster::push_feature_report(void) {
+    
+    NuBrickError error;
+    
+    return push_feature_report(error);
+}
+
+bool NuBrickMaster::push_feature_report(NuBrickError &error) {
+    
+    uint8_t frame[sizeof (_i2c_buf)];
+    
+    // Serialize under the lock, then push with only the bus lock
+    unsigned length = build_feature_frame(NULL, 0, frame, sizeof (frame), error);
+    if (length == 0) {
+        return false;
+    }
+    
+    return push_frame(frame, length, error);
+}
+
+unsigned NuBrickMaster::build_feature_frame(uint8_t *frame, unsigned size) {
+    
+    return build_feature_frame(NULL, 0, frame, size);
+}
+
+unsigned NuBrickMaster::build_feature_frame(const uint16_t *values, unsigned num_values, uint8_t *frame, unsigned size) {
+    
+    NuBrickError error;
+    
+    return build_feature_frame(values, num_values, frame, size, error);
+}
+
+unsigned NuBrickMaster::build_feature_frame(const uint16_t *values, unsigned num_values, uint8_t *frame, unsigned size, NuBrickError &error) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (! _connected) {
+        error = NuBrick_Error_NotConnected;
+        record_error(error, NULL, "NuMaker Brick I2C slave module not connected yet!!!\r\n");
+        return 0;
+    }
+    
+    if (values && num_values != _num_feature_report_fields) {
+        error = NuBrick_Error_InvalidArgument;
+        record_error(error, NULL, "Expect %u feature values, got %u\r\n", _num_feature_report_fields, num_values);
+        return 0;
+    }
+    
+    // Encode straight into frame, with no intermediate copy
+    NuBrickCursor cursor(frame, size);
+    if (! cursor.require(2)) {
+        error = NuBrick_Error_BufferOverflow;
+        record_error(error, NULL, "Frame buffer too small\r\n");
+        return 0;
+    }
+    
+    // SetFeatureReport command
+    cursor.set16_le(NuBrick_Comm_SetFeatureReport);
+    
+    // Serialize feature report
+    if (! serialize_feature_report(cursor, values)) {
+        // Still under the lock, so last error is of this call
+        error = _last_error;
+        record_error(error, NULL, "serialize_feature_report() failed\r\n");
+        return 0;
+    }
+    
+    error = NuBrick_Error_None;
+    return cursor.offset();
+}
+
+unsigned NuBrickMaster::build_output_frame(uint8_t *frame, unsigned size) {
+    
+    return build_output_frame(NULL, 0, frame, size);
+}
+
+unsigned NuBrickMaster::build_output_frame(const uint16_t *values, unsigned num_values, uint8_t *frame, unsigned size) {
+    
+    NuBrickError error;
+    
+    return build_output_frame(values, num_values, frame, size, error);
+}
+
+unsigned NuBrickMaster::build_output_frame(const uint16_t *values, unsigned num_values, uint8_t *frame, unsigned size, NuBrickError &error) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (! _connected) {
+        error = NuBrick_Error_NotConnected;
+        record_error(error, NULL, "NuMaker Brick I2C slave module not connected yet!!!\r\n");
+        return 0;
+    }
+    
+    if (values && num_values != _num_output_report_fields) {
+        error = NuBrick_Error_InvalidArgument;
+        record_error(error, NULL, "Expect %u output values, got %u\r\n", _num_output_report_fields, num_values);
+        return 0;
+    }
+    
+    // Encode straight into frame, with no intermediate copy
+    NuBrickCursor cursor(frame, size);
+    if (! cursor.require(2)) {
+        error = NuBrick_Error_BufferOverflow;
+        record_error(error, NULL, "Frame buffer too small\r\n");
+        return 0;
+    }
+    
+    // SetOutputReport command
+    cursor.set16_le(NuBrick_Comm_SetOutputReport);
+    
+    // Serialize output report
+    if (! serialize_output_report(cursor, values)) {
+        // Still under the lock, so last error is of this call
+        error = _last_error;
+        record_error(error, NULL, "serialize_output_report() failed\r\n");
+        return 0;
+    }
+    
+    error = NuBrick_Error_None;
+    return cursor.offset();
+}
+
+bool NuBrickMaster::push_frame(const uint8_t *frame, unsigned length) {
+    
+    NuBrickError error;
+    
+    return push_frame(frame, length, error);
+}
+
+bool NuBrickMaster::push_frame(const uint8_t *frame, unsigned length, NuBrickError &error) {
+    
+    {
+        // Support thread-safe
+        MutexGuard guard(this, __func__);
+        
+        error = check_ready();
+        if (error) {
+            return false;
+        }
+    }
+    
+    // Send frame, with only the bus lock
+    error = transfer_write(frame, length);
+    if (error) {
+        // Support thread-safe
+        MutexGuard guard(this, __func__);
+        
+        NUBRICK_ERROR_RETURN_FALSE(error, "i2c.write() failed\r\n");
+    }
+    
+    return true;
+}
+
+void NuBrickMaster::attach_transport(NuBrickTransport *transport) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    // Read on the bus path with only the bus lock
+    BusGuard bus_guard(_i2c);
+    
+    _transport = transport;
+}
+
+void NuBrickMaster::attach_recorder(NuBrickRecorder *recorder) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    // Read on the bus path with only the bus lock
+    BusGuard bus_guard(_i2c);
+    
+    _recorder = recorder;
+}
+
+void NuBrickMaster::attach_trace(NuBrickTrace *trace) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    // Read on the bus path with only the bus lock
+    BusGuard bus_guard(_i2c);
+    
+    _trace = trace;
+}
+
+bool NuBrickMaster::attach_mux(NuBrickI2CMux *mux, int channel) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (mux && (channel < 0 || channel >= NUBRICK_I2C_MUX_NUM_CHANNELS)) {
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_InvalidArgument, "Invalid mux channel %d\r\n", channel);
+    }
+    
+    // Read on the bus path with only the bus lock
+    BusGuard bus_guard(_i2c);
+    
+    _mux = mux;
+    _mux_channel = mux ? channel : -1;
+    
+    return true;
+}
+
+NuBrickError NuBrickMaster::get_last_error(void) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    return _last_error;
+}
+
+bool NuBrickMaster::snapshot(NuBrickSnapshot &snapshot) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    NUBRICK_CHECK_CONNECT();
+    
+    snapshot.i2c_addr = _i2c_addr;
+    snapshot.dev_desc = _dev_desc;
+    snapshot_report(_feature_report_fields, _num_feature_report_fields, snapshot.feature);
+    snapshot_report(_input_report_fields, _num_input_report_fields, snapshot.input);
+    snapshot_report(_output_report_fields, _num_output_report_fields, snapshot.output);
+    
+    return true;
+}
+
+size_t NuBrickMaster::serialize_json(char *buf, size_t size) {
+    
+    NuBrickSnapshot snap;
+    if (! snapshot(snap)) {
+        return 0;
+    }
+    
+    return NuBrickSerializer::to_json(snap, buf, size);
+}
+
+size_t NuBrickMaster::serialize_cbor(uint8_t *buf, size_t size) {
+    
+    NuBrickSnapshot snap;
+    if (! snapshot(snap)) {
+        return 0;
+    }
+    
+    return NuBrickSerializer::to_cbor(snap, buf, size);
+}
+
+bool NuBrickMaster::print_device_desc(void) {
+    
+    NuBrick_Device_Descriptor dev_desc;
+    
+    {
+        // Support thread-safe
+        MutexGuard guard(this, __func__);
+        
+        NUBRICK_CHECK_CONNECT();
+        
+        dev_desc = _dev_desc;
+    }
+    
+    // Print outside the lock
+    printf("Device descriptor length\t\t%d\r\n", dev_desc.dev_desc_len);
+    printf("Report descriptor length\t\t%d\r\n", dev_desc.report_desc_len);
+    printf("Input report length\t\t\t%d\r\n", dev_desc.input_report_len);
+    printf("Output report length\t\t\t%d\r\n", dev_desc.output_report_len);
+    printf("Get feature report length\t\t%d\r\n", dev_desc.getfeat_report_len);
+    printf("Set feature report length\t\t%d\r\n", dev_desc.setfeat_report_len);
+    printf("Company ID\t\t\t\t%d\r\n", dev_desc.cid);
+    printf("Device ID\t\t\t\t%d\r\n", dev_desc.did);
+    printf("Product ID\t\t\t\t%d\r\n", dev_desc.pid);
+    printf("Product ID\t\t\t\t%d\r\n", dev_desc.uid);
+    printf("Product ID\t\t\t\t%d\r\n", dev_desc.ucid);
+    
+    return true;
+}
+    
+bool NuBrickMaster::print_feature_report(void) {
+    
+    NuBrickReportSnapshot report;
+    
+    {
+        // Support thread-safe
+        MutexGuard guard(this, __func__);
+        
+        NUBRICK_CHECK_CONNECT();
+        
+        snapshot_report(_feature_report_fields, _num_feature_report_fields, report);
+    }
+    
+    // Print outside the lock
+    print_report(report, "feature report");
+    
+    return true;
+}
+    
+bool NuBrickMaster::print_input_report(void) {
+    
+    NuBrickReportSnapshot report;
+    
+    {
+        // Support thread-safe
+        MutexGuard guard(this, __func__);
+        
+        NUBRICK_CHECK_CONNECT();
+        
+        snapshot_report(_input_report_fields, _num_input_report_fields, report);
+    }
+    
+    // Print outside the lock
+    print_report(report, "input report");
+    
+    return true;
+}
+    
+bool NuBrickMaster::print_output_report(void) {
+    
+    NuBrickReportSnapshot report;
+    
+    {
+        // Support thread-safe
+        MutexGuard guard(this, __func__);
+        
+        NUBRICK_CHECK_CONNECT();
+        
+        snapshot_report(_output_report_fields, _num_output_report_fields, report);
+    }
+    
+    // Print outside the lock
+    print_report(report, "output report");
+    
+    return true;
+}
+
+NuBrickError NuBrickMaster::transfer_read(uint16_t comm, uint8_t *data, uint16_t length, uint32_t *seq) {
+    
+    uint8_t cmd[2];
+    Transaction txn;
+    NuBrickError error = NuBrick_Error_None;
+    
+    if (length > sizeof (_i2c_buf)) {
+        return NuBrick_Error_BufferOverflow;
+    }
+    
+    nu_set16_le(cmd, comm);
+    memset(&txn, 0x00, sizeof (txn));
+    
+    {
+        BusGuard guard(_i2c);
+        
+        // Order of transfers on the bus, for publishing in order
+        if (seq) {
+            *seq = ++ _txn_seq;
+        }
+        
+        if (! select_mux(txn, comm)) {
+            error = NuBrick_Error_BusWrite;
+        }
+        else if (bus_write(txn, cmd, 2, true)) {
+            error = NuBrick_Error_BusWrite;
+        }
+        else if (bus_read(txn, data, length, false)) {
+            error = NuBrick_Error_BusRead;
+        }
+    }
+    
+    // Account with the lock after the bus lock is released
+    account_transaction(txn);
+    
+    return error;
+}
+
+NuBrickError NuBrickMaster::transfer_write(const uint8_t *data, uint16_t length) {
+    
+    Transaction txn;
+    NuBrickError error = NuBrick_Error_None;
+    
+    memset(&txn, 0x00, sizeof (txn));
+    
+    {
+        BusGuard guard(_i2c);
+        
+        if (! select_mux(txn, (length >= 2) ? nu_get16_le(data) : (uint16_t) NuBrick_Comm_None)) {
+            error = NuBrick_Error_BusWrite;
+        }
+        else if (bus_write(txn, data, length, false)) {
+            error = NuBrick_Error_BusWrite;
+        }
+    }
+    
+    // Account with the lock after the bus lock is released
+    account_transaction(txn);
+    
+    return error;
+}
+
+bool NuBrickMaster::select_mux(Transaction &txn, uint16_t comm) {
+    
+    // Close channels of other muxes first, all of them if on the bus directly, so no brick of
+    // the same address behind another mux answers along
+    NuBrickI2CMux *mux;
+    for (mux = NuBrickI2CMux::get_first(_i2c); mux; mux = mux->get_next()) {
+        if (mux != _mux && ! write_mux(txn, comm, mux, -1)) {
+            return false;
+        }
+    }
+    
+    return _mux == NULL || write_mux(txn, comm, _mux, _mux_channel);
+}
+
+bool NuBrickMaster::write_mux(Transaction &txn, uint16_t comm, NuBrickI2CMux *mux, int channel) {
+    
+    uint8_t ctrl;
+    
+    // Channel selected or closed already
+    if (! mux->prepare_select(channel, ctrl)) {
+        return true;
+    }
+    
+    // First mux write opens the transaction of the command, so its failure counts against this brick
+    if (! txn.active) {
+        begin_transaction(txn, comm);
+    }
+    txn.bytes += 1;
+    
+    int mux_addr = mux->get_i2c_addr();
+    int rc = _transport ? _transport->write(mux_addr, (const char *) &ctrl, 1, false) :
+        _i2c.write(mux_addr, (const char *) &ctrl, 1, false);
+    
+    record_bus(txn, 0, mux_addr, &ctrl, 1, rc);
+    mux->end_select(channel, rc == 0);
+    
+    if (rc) {
+        end_transaction(txn, false);
+    }
+    
+    return rc == 0;
+}
+
+NuBrickError NuBrickMaster::decode_report(const uint8_t *report, uint16_t report_len, uint16_t read_len, const uint8_t *lengths, unsigned num_fields, uint16_t *values) const {
+    
+    const uint8_t *pos = report;
+    const uint8_t *end = report + read_len;
+    
+    if (num_fields > NUBRICK_MAX_REPORT_FIELDS) {
+        return NuBrick_Error_BufferOverflow;
+    }
+    
+    // Report length, which is of full report even on partial read
+    if (read_len < 2 || read_len > report_len || nu_get16_le(pos) != report_len) {
+        return NuBrick_Error_LengthMismatch;
+    }
+    pos += 2;
+    
+    // Validate once that fields fit in, then decode unchecked
+    unsigned fields_len = 0;
+    unsigned i;
+    for (i = 0; i < num_fields; i ++) {
+        fields_len += lengths[i];
+    }
+    if ((pos + fields_len) > end) {
+        return NuBrick_Error_LengthMismatch;
+    }
+    
+    // Values of fields
+    for (i = 0; i < num_fields; i ++) {
+        switch (lengths[i]) {
+            case 1:
+                values[i] = *pos;
+                break;
+                
+            case 2:
+                values[i] = nu_get16_le(pos);
+                break;
+                
+            default:
+                return NuBrick_Error_FieldLength;
+        }
+        pos += lengths[i];
+    }
+    
+    return NuBrick_Error_None;
+}
+
+void NuBrickMaster::get_field_lengths(const NuBrickField *fields, unsigned num_fields, uint8_t *lengths) {
     
-    if (_connected) {
-        return true;
+    unsigned i;
+    for (i = 0; i < num_fields && i < NUBRICK_MAX_REPORT_FIELDS; i ++) {
+        lengths[i] = fields[i]._length;
     }
+}
+
+bool NuBrickMaster::publish_seq(uint32_t seq, uint32_t &published_seq) {
     
-    // Get device descriptor
-    if (! pull_device_desc()) {
-        _connected = false;
-        NUBRICK_ERROR_RETURN_FALSE("pull_device_desc() failed\r\n");
-    }
-    // Get report descriptor
-    if (! pull_report_desc()) {
-        _connected = false;
-        NUBRICK_ERROR_RETURN_FALSE("pull_report_desc() failed\r\n");
+    // Wrap-safe comparison
+    if ((int32_t) (seq - published_seq) <= 0) {
+        return false;
     }
     
-    _connected = true;
+    published_seq = seq;
     return true;
 }
 
-NuBrickField &NuBrickMaster::operator[](const char *report_field_name) {
-    // Support thread-safe
-    MutexGuard guard;
+void NuBrickMaster::publish_input_report(const uint8_t *report, uint16_t report_len, const uint16_t *values) {
     
-    if (! report_field_name) {
-        NUBRICK_ERROR_RETURN_NULL_FIELD("NULL string not support\r\n");
+    // All fields are fresh, changed or not
+    rtos::Kernel::Clock::time_point now = rtos::Kernel::Clock::now();
+    unsigned i;
+    for (i = 0; i < _num_input_report_fields; i ++) {
+        _input_report_fields[i].touch(now);
     }
+    _input_pulled_mask = (_num_input_report_fields < 32) ? ((1UL << _num_input_report_fields) - 1) : 0xFFFFFFFFUL;
     
-    const char *dot_plus_field_name = strchr(report_field_name, '.');
-    if (dot_plus_field_name == NULL) {
-        NUBRICK_ERROR_RETURN_NULL_FIELD("%s not support\r\n", report_field_name);
+    // Raw input report unchanged since last time, nothing to publish
+    _input_changed_mask = 0;
+    if (_input_report_prev_valid && memcmp(_input_report_prev, report, report_len) == 0) {
+        return;
     }
-  
-    const char *field_name = dot_plus_field_name + 1;
-    unsigned report_name_len = dot_plus_field_name - report_field_name;
-    
-    if (strncmp("feature", report_field_name, report_name_len) == 0) {
-        NuBrickField *field = _feature_report_fields;
-        NuBrickField *field_end = _feature_report_fields + _num_feature_report_fields;
     
-        for (; field != field_end; field ++) {
-            const char *field_name_iter = field->_name;
-            
-            if (strcmp(field_name, field_name_iter) == 0) {
-                return *field;
-            }
+    for (i = 0; i < _num_input_report_fields; i ++) {
+        // No previous raw input report means all fields changed
+        if (! _input_report_prev_valid || _input_report_fields[i]._value != values[i]) {
+            _input_changed_mask |= 1UL << i;
         }
-        NUBRICK_ERROR_RETURN_NULL_FIELD("%s not support\r\n", report_field_name);
+        _input_report_fields[i]._value = values[i];
     }
-    else if (strncmp("input", report_field_name, report_name_len) == 0) {
-        NuBrickField *field = _input_report_fields;
-        NuBrickField *field_end = _input_report_fields + _num_input_report_fields;
     
-        for (; field != field_end; field ++) {
-            const char *field_name_iter = field->_name;
-            
-            if (strcmp(field_name, field_name_iter) == 0) {
-                return *field;
-            }
-        }
-        NUBRICK_ERROR_RETURN_NULL_FIELD("%s not support\r\n", report_field_name);
-        
-    }
-    else if (strncmp("output", report_field_name, report_name_len) == 0) {
-        NuBrickField *field = _output_report_fields;
-        NuBrickField *field_end = _output_report_fields + _num_output_report_fields;
+    // Keep raw input report for comparison next time
+    memcpy(_input_report_prev, report, report_len);
+    _input_report_prev_valid = true;
+}
+
+void NuBrickMaster::publish_input_fields(const uint8_t *report, uint32_t field_mask, unsigned num_fields, const uint16_t *values) {
+    
+    rtos::Kernel::Clock::time_point now = rtos::Kernel::Clock::now();
+    const uint8_t *pos = report + 2;
     
-        for (; field != field_end; field ++) {
-            const char *field_name_iter = field->_name;
+    _input_pulled_mask = field_mask;
+    _input_changed_mask = 0;
+    
+    unsigned i;
+    for (i = 0; i < num_fields; i ++) {
+        NuBrickField &field = _input_report_fields[i];
+        
+        if (field_mask & (1UL << i)) {
+            // Never pulled before means changed
+            if (field._updated == 0 || field._value != values[i]) {
+                _input_changed_mask |= 1UL << i;
+            }
+            field._value = values[i];
+            field.touch(now);
             
-            if (strcmp(field_name, field_name_iter) == 0) {
-                return *field;
+            // Keep raw input report for comparison consistent with published values
+            if (_input_report_prev_valid) {
+                memcpy(_input_report_prev + (pos - report), pos, field._length);
             }
         }
-        NUBRICK_ERROR_RETURN_NULL_FIELD("%s not support\r\n", report_field_name);
+        pos += field._length;
     }
-    else {
-        NUBRICK_ERROR_RETURN_NULL_FIELD("%s not support\r\n", report_field_name);
+}
+
+int NuBrickMaster::bus_write(Transaction &txn, const uint8_t *data, int length, bool repeated) {
+    
+    // Transaction starts with command write, unless opened by mux write
+    if (! txn.active) {
+        begin_transaction(txn, (length >= 2) ? nu_get16_le(data) : (uint16_t) NuBrick_Comm_None);
     }
+    txn.bytes += length;
     
-}
+    int rc = _transport ? _transport->write(_i2c_addr, (const char *) data, length, repeated) :
+        _i2c.write(_i2c_addr, (const char *) data, length, repeated);
     
-bool NuBrickMaster::pull_device_desc(void) {
-    // Support thread-safe
-    MutexGuard guard;
+    record_bus(txn, repeated ? NuBrick_RecordFlag_Repeated : 0, _i2c_addr, data, length, rc);
     
-    // Send GetDeviceDescriptor command
-    nu_set16_le(_i2c_buf, NuBrick_Comm_GetDeviceDesc);    
-    if (_i2c.write(_i2c_addr, (char *) _i2c_buf, 2, true)) {
-        NUBRICK_ERROR_RETURN_FALSE("i2c.write() failed\r\n");
+    // Transaction ends on failure or on stop condition
+    if (rc || ! repeated) {
+        end_transaction(txn, rc == 0);
     }
     
-    // Receive device descriptor
-    if (_i2c.read(_i2c_addr, (char *) _i2c_buf, NuBrick_DeviceDesc_Len, false)) {
-        NUBRICK_ERROR_RETURN_FALSE("i2c.read() failed\r\n");
+    return rc;
+}
+
+int NuBrickMaster::bus_read(Transaction &txn, uint8_t *data, int length, bool repeated) {
+    
+    // Read not led by command write
+    if (! txn.active) {
+        begin_transaction(txn, NuBrick_Comm_None);
     }
+    txn.bytes += length;
     
-    // Un-serialize device descriptor
-    _i2c_buf_pos = _i2c_buf;
-    if (! unserialize_device_desc()) {
-        NUBRICK_ERROR_RETURN_FALSE("unserialize_device_desc() failed\r\n");
+    int rc = _transport ? _transport->read(_i2c_addr, (char *) data, length, repeated) :
+        _i2c.read(_i2c_addr, (char *) data, length, repeated);
+    
+    record_bus(txn, NuBrick_RecordFlag_Read | (repeated ? NuBrick_RecordFlag_Repeated : 0), _i2c_addr, data, length, rc);
+    
+    if (rc || ! repeated) {
+        end_transaction(txn, rc == 0);
     }
     
-    return true;
+    return rc;
 }
 
-bool NuBrickMaster::pull_report_desc(void) {
-    // Support thread-safe
-    MutexGuard guard;
+void NuBrickMaster::record_bus(const Transaction &txn, uint8_t flags, int addr, const uint8_t *data, int length, int rc) {
     
-    // Send GetReportDescriptor command
-    nu_set16_le(_i2c_buf, NuBrick_Comm_GetReportDesc);    
-    if (_i2c.write(_i2c_addr, (char *) _i2c_buf, 2, true)) {
-        NUBRICK_ERROR_RETURN_FALSE("i2c.write() failed\r\n");
+    if (rc) {
+        flags |= NuBrick_RecordFlag_Failed;
     }
     
-    // Receive report descriptor
-    if (_i2c.read(_i2c_addr, (char *) _i2c_buf, _dev_desc.report_desc_len, false)) {
-        NUBRICK_ERROR_RETURN_FALSE("i2c.read() failed\r\n");
+    if (_recorder) {
+        _recorder->record(flags, addr, data, length);
     }
-    
-    // Un-serialize report descriptor
-    _i2c_buf_pos = _i2c_buf;
-    if (! unserialize_report_desc()) {
-        NUBRICK_ERROR_RETURN_FALSE("unserialize_report_desc() failed\r\n");
+    if (_trace) {
+        _trace->record(flags, addr, txn.comm, length, rc);
     }
+}
+
+void NuBrickMaster::begin_transaction(Transaction &txn, uint16_t comm) {
     
-    return true;
+    txn.comm = comm;
+    txn.active = true;
+    txn.start = us_ticker_read();
+    txn.bytes = 0;
 }
+
+void NuBrickMaster::end_transaction(Transaction &txn, bool success) {
+    
+    txn.latency = us_ticker_read() - txn.start;
+    txn.success = success;
+    txn.active = false;
+    txn.ended = true;
+}
+
+void NuBrickMaster::account_transaction(const Transaction &txn) {
+    
+    // Nothing went out on the bus
+    if (! txn.ended) {
+        return;
+    }
     
-bool NuBrickMaster::pull_input_report(void) {
     // Support thread-safe
-    MutexGuard guard;
+    MutexGuard guard(this, __func__);
     
-    NUBRICK_CHECK_CONNECT();
+    NuBrickCommStats &stats = _txn_stats.comm[(txn.comm < NUBRICK_NUM_COMMS) ? txn.comm : (uint16_t) NuBrick_Comm_None];
     
-    // Send GetInputReport command
-    nu_set16_le(_i2c_buf, NuBrick_Comm_GetInputReport);    
-    if (_i2c.write(_i2c_addr, (char *) _i2c_buf, 2, true)) {
-        NUBRICK_ERROR_RETURN_FALSE("i2c.write() failed\r\n");
+    stats.calls ++;
+    if (! txn.success) {
+        stats.failures ++;
     }
-    
-    // Receive input report
-    if (_i2c.read(_i2c_addr, (char *) _i2c_buf, _dev_desc.input_report_len, false)) {
-        NUBRICK_ERROR_RETURN_FALSE("i2c.read() failed\r\n");
+    stats.bytes += txn.bytes;
+    stats.latency_total += txn.latency;
+    if (txn.latency > stats.latency_max) {
+        stats.latency_max = txn.latency;
     }
     
-    // Un-serialize input report
-    _i2c_buf_pos = _i2c_buf;
-    if (! unserialize_input_report()) {
-        NUBRICK_ERROR_RETURN_FALSE("unserialize_input_report() failed\r\n");
-    }
+    stats.latency_hist[log2_bucket(txn.latency)] ++;
     
-    return true;
+    // Track health. Only probe() brings degraded module back.
+    if (txn.success) {
+        _consecutive_failures = 0;
+    }
+    else if (++ _consecutive_failures >= _degrade_threshold && _connected) {
+        _health = NuBrick_Health_Degraded;
+    }
 }
 
-bool NuBrickMaster::push_output_report(void) {
-    // Support thread-safe
-    MutexGuard guard;
+unsigned NuBrickMaster::log2_bucket(uint32_t time_us) {
     
-    NUBRICK_CHECK_CONNECT();
+    unsigned bucket = 0;
+    while (time_us > 1 && bucket < (NUBRICK_LATENCY_BUCKETS - 1)) {
+        time_us >>= 1;
+        bucket ++;
+    }
     
-    _i2c_buf_pos = _i2c_buf;
+    return bucket;
+}
+
+bool NuBrickMaster::get_lock_stats(NuBrickLockStats &stats, bool reset) {
     
-    // Send SetOutputReport command
-    set16_le_next(NuBrick_Comm_SetOutputReport);    
+#if NUBRICK_LOCK_TRACE
+    // Not traced itself
+    _mutex->lock();
     
-    // Serialize output report
-    if (! serialize_output_report()) {
-        NUBRICK_ERROR_RETURN_FALSE("serialize_output_report() failed\r\n");
+    stats = _lock_stats;
+    if (reset) {
+        memset(&_lock_stats, 0x00, sizeof (_lock_stats));
     }
     
-    // Send Output report
-    if (_i2c.write(_i2c_addr, (char *) _i2c_buf, _i2c_buf_pos - _i2c_buf, false)) {
-        NUBRICK_ERROR_RETURN_FALSE("i2c.write() failed\r\n");
+    _mutex->unlock();
+    
+    // Sort holders by total hold time outside the lock
+    unsigned i, j;
+    for (i = 1; i < stats.num_holders; i ++) {
+        NuBrickLockHolder holder = stats.holders[i];
+        for (j = i; j > 0 && stats.holders[j - 1].hold_total < holder.hold_total; j --) {
+            stats.holders[j] = stats.holders[j - 1];
+        }
+        stats.holders[j] = holder;
     }
     
     return true;
+#else
+    (void) stats;
+    (void) reset;
+    return false;
+#endif
 }
+
+bool NuBrickMaster::print_lock_stats(void) {
     
-bool NuBrickMaster::pull_feature_report(void) {
-    // Support thread-safe
-    MutexGuard guard;
+    NuBrickLockStats stats;
+    if (! get_lock_stats(stats)) {
+        return false;
+    }
     
-    NUBRICK_CHECK_CONNECT();
+    printf("Lock acquisitions\t\t\t%lu\r\n", (unsigned long) stats.acquisitions);
+    printf("Max wait\t\t\t\t%lu us (%s)\r\n", (unsigned long) stats.wait_max,
+        stats.wait_max_method ? stats.wait_max_method : "-");
+    printf("Holder\t\t\t\t\tcount\twait_max\thold_mean\thold_max\r\n");
     
-    // Send GetFeatureReport command
-    nu_set16_le(_i2c_buf, NuBrick_Comm_GetFeatureReport);    
-    if (_i2c.write(_i2c_addr, (char *) _i2c_buf, 2, true)) {
-        NUBRICK_ERROR_RETURN_FALSE("i2c.write() failed\r\n");
+    unsigned i;
+    for (i = 0; i < stats.num_holders; i ++) {
+        const NuBrickLockHolder &holder = stats.holders[i];
+        printf("0x%02x %-30s\t%lu\t%lu\t\t%lu\t\t%lu\r\n", holder.i2c_addr, holder.method,
+            (unsigned long) holder.count, (unsigned long) holder.wait_max,
+            (unsigned long) (holder.hold_total / holder.count), (unsigned long) holder.hold_max);
     }
     
-    // Receive feature report
-    if (_i2c.read(_i2c_addr, (char *) _i2c_buf, _dev_desc.getfeat_report_len, false)) {
-        NUBRICK_ERROR_RETURN_FALSE("i2c.read() failed\r\n");
+    return true;
+}
+
+#if NUBRICK_LOCK_TRACE
+void NuBrickMaster::lock_traced(const NuBrickMaster *master, const char *method) {
+    
+    uint32_t t0 = us_ticker_read();
+    _mutex->lock();
+    
+    // Nested acquisitions of the recursive mutex never wait
+    if (_lock_depth ++ == 0) {
+        _lock_start = us_ticker_read();
+        _lock_wait = _lock_start - t0;
+        _lock_master = master;
+        // Brick is alive while in its own method. Never dereferenced afterwards.
+        _lock_i2c_addr = master ? master->_i2c_addr : 0;
+        _lock_method = method;
     }
+}
+
+void NuBrickMaster::unlock_traced(void) {
     
-    // Un-serialize feature report
-    _i2c_buf_pos = _i2c_buf;
-    if (! unserialize_feature_report()) {
-        NUBRICK_ERROR_RETURN_FALSE("unserialize_feature_report() failed\r\n");
+    if (-- _lock_depth == 0) {
+        uint32_t hold = us_ticker_read() - _lock_start;
+        
+        _lock_stats.acquisitions ++;
+        _lock_stats.wait_hist[log2_bucket(_lock_wait)] ++;
+        _lock_stats.hold_hist[log2_bucket(hold)] ++;
+        if (_lock_wait > _lock_stats.wait_max) {
+            _lock_stats.wait_max = _lock_wait;
+            _lock_stats.wait_max_master = _lock_master;
+            _lock_stats.wait_max_i2c_addr = _lock_i2c_addr;
+            _lock_stats.wait_max_method = _lock_method;
+        }
+        
+        // Look up holder by (brick, method). Method names are string literals from __func__.
+        NuBrickLockHolder *holder = NULL;
+        unsigned i;
+        for (i = 0; i < _lock_stats.num_holders; i ++) {
+            if (_lock_stats.holders[i].master == _lock_master && _lock_stats.holders[i].method == _lock_method) {
+                holder = _lock_stats.holders + i;
+                break;
+            }
+        }
+        if (holder == NULL && _lock_stats.num_holders < NUBRICK_LOCK_TRACE_HOLDERS) {
+            holder = _lock_stats.holders + _lock_stats.num_holders ++;
+            holder->master = _lock_master;
+            holder->i2c_addr = _lock_i2c_addr;
+            holder->method = _lock_method;
+        }
+        
+        if (holder) {
+            holder->count ++;
+            holder->wait_total += _lock_wait;
+            if (_lock_wait > holder->wait_max) {
+                holder->wait_max = _lock_wait;
+            }
+            holder->hold_total += hold;
+            if (hold > holder->hold_max) {
+                holder->hold_max = hold;
+            }
+        }
+        else {
+            _lock_stats.holders_dropped ++;
+        }
     }
     
-    return true;
+    _mutex->unlock();
 }
+#endif
 
-bool NuBrickMaster::push_feature_report(void) {
-    // Support thread-safe
-    MutexGuard guard;
+void NuBrickMaster::record_error(NuBrickError code, const char *name, const char *fmt, int32_t a0, int32_t a1, int32_t a2) {
+    // NuBrickLog::post() is single-producer, serialized by the lock
+    MutexGuard guard(this, __func__);
     
-    NUBRICK_CHECK_CONNECT();
+    _last_error = code;
     
-    _i2c_buf_pos = _i2c_buf;
+    // Format later out of the critical section
+    if (_debug) {
+        NuBrickLog::post(_i2c_addr, code, name, fmt, a0, a1, a2);
+    }
+}
+
+NuBrickError NuBrickMaster::check_ready(void) {
     
-    // Send SetFeatureReport command
-    set16_le_next(NuBrick_Comm_SetFeatureReport);    
-   
-    // Serialize feature report
-    if (! serialize_feature_report()) {
-        NUBRICK_ERROR_RETURN_FALSE("serialize_feature_report() failed\r\n");
+    if (! _connected) {
+        record_error(NuBrick_Error_NotConnected, NULL, "NuMaker Brick I2C slave module not connected yet!!!\r\n");
+        return NuBrick_Error_NotConnected;
     }
     
-    // Send feature report
-    if (_i2c.write(_i2c_addr, (char *) _i2c_buf, _i2c_buf_pos - _i2c_buf, false)) {
-        NUBRICK_ERROR_RETURN_FALSE("i2c.write() failed\r\n");
+    if (_health == NuBrick_Health_Degraded) {
+        record_error(NuBrick_Error_Degraded, NULL, "NuMaker Brick I2C slave module degraded\r\n");
+        return NuBrick_Error_Degraded;
     }
     
-    return true;
+    return NuBrick_Error_None;
 }
 
-bool NuBrickMaster::print_device_desc(void) {
-    // Support thread-safe
-    MutexGuard guard;
-    
-    NUBRICK_CHECK_CONNECT();
-    
-    printf("Device descriptor length\t\t%d\r\n", _dev_desc.dev_desc_len);
-    printf("Report descriptor length\t\t%d\r\n", _dev_desc.report_desc_len);
-    printf("Input report length\t\t\t%d\r\n", _dev_desc.input_report_len);
-    printf("Output report length\t\t\t%d\r\n", _dev_desc.output_report_len);
-    printf("Get feature report length\t\t%d\r\n", _dev_desc.getfeat_report_len);
-    printf("Set feature report length\t\t%d\r\n", _dev_desc.setfeat_report_len);
-    printf("Company ID\t\t\t\t%d\r\n", _dev_desc.cid);
-    printf("Device ID\t\t\t\t%d\r\n", _dev_desc.did);
-    printf("Product ID\t\t\t\t%d\r\n", _dev_desc.pid);
-    printf("Product ID\t\t\t\t%d\r\n", _dev_desc.uid);
-    printf("Product ID\t\t\t\t%d\r\n", _dev_desc.ucid);
+NuBrickField *NuBrickMaster::lookup_field(const char *report_field_name) {
     
-    return true;
-}
+    if (! report_field_name) {
+        record_error(NuBrick_Error_InvalidArgument, NULL, "NULL string not support\r\n");
+        return NULL;
+    }
     
-bool NuBrickMaster::print_feature_report(void) {
-    // Support thread-safe
-    MutexGuard guard;
+    const char *dot_plus_field_name = strchr(report_field_name, '.');
+    if (dot_plus_field_name == NULL) {
+        record_error(NuBrick_Error_FieldNotFound, report_field_name, "%s not support\r\n");
+        return NULL;
+    }
+  
+    const char *field_name = dot_plus_field_name + 1;
+    unsigned report_name_len = dot_plus_field_name - report_field_name;
+    NuBrickField *field = NULL;
+    NuBrickField *field_end = NULL;
     
-    NUBRICK_CHECK_CONNECT();
+    if (strncmp("feature", report_field_name, report_name_len) == 0) {
+        field = _feature_report_fields;
+        field_end = _feature_report_fields + _num_feature_report_fields;
+    }
+    else if (strncmp("input", report_field_name, report_name_len) == 0) {
+        field = _input_report_fields;
+        field_end = _input_report_fields + _num_input_report_fields;
+    }
+    else if (strncmp("output", report_field_name, report_name_len) == 0) {
+        field = _output_report_fields;
+        field_end = _output_report_fields + _num_output_report_fields;
+    }
     
-    print_report(_feature_report_fields, _num_feature_report_fields, "feature report");
+    for (; field != field_end; field ++) {
+        const char *field_name_iter = field->_name;
+        
+        if (strcmp(field_name, field_name_iter) == 0) {
+            return field;
+        }
+    }
     
-    return true;
+    record_error(NuBrick_Error_FieldNotFound, report_field_name, "%s not support\r\n");
+    return NULL;
 }
+
+int NuBrickMaster::add_subscription(const char *report_field_name, FieldCallback cb, osThreadId_t thread_id, uint32_t flags, uint16_t deadband) {
     
+    NuBrickField *field = lookup_field(report_field_name);
+    if (field == NULL) {
+        return -1;
+    }
     
-bool NuBrickMaster::print_input_report(void) {
-    // Support thread-safe
-    MutexGuard guard;
-    
-    NUBRICK_CHECK_CONNECT();
+    // Only input report fields get updated on their own
+    if (field < _input_report_fields || field >= (_input_report_fields + _num_input_report_fields)) {
+        record_error(NuBrick_Error_InvalidArgument, report_field_name, "%s not input report field\r\n");
+        return -1;
+    }
     
-    print_report(_input_report_fields, _num_input_report_fields, "input report");
+    int handle;
+    for (handle = 0; handle < NUBRICK_MAX_SUBSCRIPTIONS; handle ++) {
+        Subscription *sub = _subscriptions + handle;
+        
+        if (! sub->used) {
+            sub->cb = cb;
+            sub->thread_id = thread_id;
+            sub->flags = flags;
+            sub->deadband = deadband;
+            sub->last_value = 0;
+            sub->field_pos = field - _input_report_fields;
+            sub->notified = false;
+            sub->used = true;
+            return handle;
+        }
+    }
     
-    return true;
+    record_error(NuBrick_Error_NoResource, report_field_name, "No free subscription for %s\r\n");
+    return -1;
 }
+
+void NuBrickMaster::notify_subscribers(void) {
     
+    // Observers get every input report, full or partial
+    unsigned i;
+    for (i = 0; i < NUBRICK_MAX_INPUT_OBSERVERS; i ++) {
+        if (_input_observers[i]) {
+            _input_observers[i](*this, _input_pulled_mask, _input_changed_mask);
+        }
+    }
     
-bool NuBrickMaster::print_output_report(void) {
-    // Support thread-safe
-    MutexGuard guard;
-    
-    NUBRICK_CHECK_CONNECT();
-    
-    print_report(_output_report_fields, _num_output_report_fields, "output report");
+    if (! _input_changed_mask) {
+        return;
+    }
     
-    return true;
+    Subscription *sub = _subscriptions;
+    Subscription *sub_end = _subscriptions + NUBRICK_MAX_SUBSCRIPTIONS;
+    for (; sub != sub_end; sub ++) {
+        if (! sub->used || ! (_input_changed_mask & (1UL << sub->field_pos))) {
+            continue;
+        }
+        
+        NuBrickField *field = _input_report_fields + sub->field_pos;
+        uint16_t value = field->_value;
+        
+        // Suppress changes within deadband since last notification
+        if (sub->notified) {
+            uint16_t delta = (value > sub->last_value) ? (value - sub->last_value) : (sub->last_value - value);
+            if (delta <= sub->deadband) {
+                continue;
+            }
+        }
+        
+        sub->last_value = value;
+        sub->notified = true;
+        
+        if (sub->cb) {
+            sub->cb(*field);
+        }
+        else {
+            osThreadFlagsSet(sub->thread_id, sub->flags);
+        }
+    }
 }
 
 void NuBrickMaster::add_feature_fields(const NuBrickField::IndexName *field_index_name, unsigned num_index_name) {
@@ -348,6 +1631,15 @@ void NuBrickMaster::add_input_fields(const NuBrickField::IndexName *field_index_
     
     remove_report_fields(_input_report_fields, _num_input_report_fields);
     add_report_fields(field_index_name, num_index_name, _input_report_fields, _num_input_report_fields);
+    
+    // Over flags, e.g. "over_flag", "temp_over_flag", speed up adaptive polling
+    _input_alarm_mask = 0;
+    unsigned i;
+    for (i = 0; i < _num_input_report_fields; i ++) {
+        if (strstr(_input_report_fields[i]._name, "over_flag")) {
+            _input_alarm_mask |= 1UL << i;
+        }
+    }
 }
 
 void NuBrickMaster::remove_input_fields(void) {
@@ -397,61 +1689,72 @@ void NuBrickMaster::NuBrickMaster::remove_report_fields(NuBrickField *&report_fi
     num_report_fields = 0;
 }
 
-bool NuBrickMaster::unserialize_device_desc(void) {
+bool NuBrickMaster::unserialize_device_desc(NuBrickCursor &cursor) {
 
+    // Validate once against fixed layout of device descriptor
+    if (! cursor.require(NuBrick_DeviceDesc_Len)) {
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_LengthMismatch, "Device descriptor too short\r\n");
+    }
+    
     // Device descriptor length
-    _dev_desc.dev_desc_len = get16_le_next();
+    _dev_desc.dev_desc_len = cursor.get16_le();
     
     // Report descriptor length
-    _dev_desc.report_desc_len = get16_le_next();
+    _dev_desc.report_desc_len = cursor.get16_le();
     
     // Input report length
-    _dev_desc.input_report_len = get16_le_next();
+    _dev_desc.input_report_len = cursor.get16_le();
     
     // Output report length
-    _dev_desc.output_report_len = get16_le_next();
+    _dev_desc.output_report_len = cursor.get16_le();
     
     // Get feature report length
-    _dev_desc.getfeat_report_len = get16_le_next();
+    _dev_desc.getfeat_report_len = cursor.get16_le();
     
     // Set feature report length
-    _dev_desc.setfeat_report_len = get16_le_next();
+    _dev_desc.setfeat_report_len = cursor.get16_le();
     
     // CID
-    _dev_desc.cid = get16_le_next();
+    _dev_desc.cid = cursor.get16_le();
     
     // DID
-    _dev_desc.did = get16_le_next();
+    _dev_desc.did = cursor.get16_le();
     
     // PID
-    _dev_desc.pid = get16_le_next();
+    _dev_desc.pid = cursor.get16_le();
     
     // UID
-    _dev_desc.uid = get16_le_next();
+    _dev_desc.uid = cursor.get16_le();
     
     // UCID
-    _dev_desc.ucid = get16_le_next();
+    _dev_desc.ucid = cursor.get16_le();
     
     // Reserved 1
-    _dev_desc.reserved1 = get16_le_next();
+    _dev_desc.reserved1 = cursor.get16_le();
     
     // Reserved 2
-    _dev_desc.reserved2 = get16_le_next();
+    _dev_desc.reserved2 = cursor.get16_le();
     
     if (_dev_desc.dev_desc_len != NuBrick_DeviceDesc_Len) {
-        NUBRICK_ERROR_RETURN_FALSE("Length of device descriptor doesn't match\r\n");
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_LengthMismatch, "Length of device descriptor doesn't match\r\n");
     }
     
     return true;
 }
 
 
-bool NuBrickMaster::unserialize_report_desc(void) {
+bool NuBrickMaster::unserialize_report_desc(NuBrickCursor &cursor) {
+    
+    // Validate once against layout, then decode unchecked
+    NuBrickError error = validate_report_desc(cursor);
+    if (error) {
+        NUBRICK_ERROR_RETURN_FALSE(error, "Malformed report descriptor\r\n");
+    }
     
     // Report descriptor length
-    uint16_t report_desc_len = get16_le_next();
+    uint16_t report_desc_len = cursor.get16_le();
     if (report_desc_len != _dev_desc.report_desc_len) {
-        NUBRICK_ERROR_RETURN_FALSE("Length of report descriptor doesn't match\r\n");
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_LengthMismatch, "Length of report descriptor doesn't match\r\n");
     }
     
     uint16_t desc_type;
@@ -464,17 +1767,17 @@ bool NuBrickMaster::unserialize_report_desc(void) {
     }
     
     // Feature report descriptor type
-    desc_type = get16_be_next();
+    desc_type = cursor.get16_be();
     if (desc_type != NuBrick_DescType_FeatureReport) {
-        NUBRICK_ERROR_RETURN_FALSE("Expect feature report descriptor type %d, but %d received\r\n", NuBrick_DescType_FeatureReport, desc_type);
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_DescType, "Expect feature report descriptor type %d, but %d received\r\n", NuBrick_DescType_FeatureReport, desc_type);
     }
     
     // Un-serialize feature report fields from report descriptor
     field = _feature_report_fields;
     field_end = _feature_report_fields + _num_feature_report_fields;
     for (; field != field_end; field ++) {
-        if (! unserialize_field_from_report_desc(field)) {
-            NUBRICK_ERROR_RETURN_FALSE("unserialize_field_from_report_desc() failed\r\n");
+        if (! unserialize_field_from_report_desc(cursor, field)) {
+            NUBRICK_ERROR_RETURN_FALSE(_last_error, "unserialize_field_from_report_desc() failed\r\n");
         }
     }
 
@@ -484,17 +1787,17 @@ bool NuBrickMaster::unserialize_report_desc(void) {
     }
     
     // Input report descriptor type
-    desc_type = get16_be_next();
+    desc_type = cursor.get16_be();
     if (desc_type != NuBrick_DescType_InputReport) {
-        NUBRICK_ERROR_RETURN_FALSE("Expect input report descriptor type %d, but %d received\r\n", NuBrick_DescType_InputReport, desc_type);
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_DescType, "Expect input report descriptor type %d, but %d received\r\n", NuBrick_DescType_InputReport, desc_type);
     }
     
     // Un-serialize input report fields from report descriptor
     field = _input_report_fields;
     field_end = _input_report_fields + _num_input_report_fields;
     for (; field != field_end; field ++) {
-        if (! unserialize_field_from_report_desc(field)) {
-            NUBRICK_ERROR_RETURN_FALSE("unserialize_field_from_report_desc() failed\r\n");
+        if (! unserialize_field_from_report_desc(cursor, field)) {
+            NUBRICK_ERROR_RETURN_FALSE(_last_error, "unserialize_field_from_report_desc() failed\r\n");
         }
     }
     
@@ -504,240 +1807,248 @@ bool NuBrickMaster::unserialize_report_desc(void) {
     }
     
     // Output report descriptor type
-    desc_type = get16_be_next();
+    desc_type = cursor.get16_be();
     if (desc_type != NuBrick_DescType_OutputReport) {
-        NUBRICK_ERROR_RETURN_FALSE("Expect output report descriptor type %d, but %d received\r\n", NuBrick_DescType_OutputReport, desc_type);
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_DescType, "Expect output report descriptor type %d, but %d received\r\n", NuBrick_DescType_OutputReport, desc_type);
     }
     
     // Un-serialize output report fields from report descriptor
     field = _output_report_fields;
     field_end = _output_report_fields + _num_output_report_fields;
     for (; field != field_end; field ++) {
-        if (! unserialize_field_from_report_desc(field)) {
-            NUBRICK_ERROR_RETURN_FALSE("unserialize_field_from_report_desc() failed\r\n");
+        if (! unserialize_field_from_report_desc(cursor, field)) {
+            NUBRICK_ERROR_RETURN_FALSE(_last_error, "unserialize_field_from_report_desc() failed\r\n");
         }
     }
     
     return true;
 }
     
-bool NuBrickMaster::unserialize_input_report(void) {
+bool NuBrickMaster::serialize_output_report(NuBrickCursor &cursor, const uint16_t *values) {
     
-    // Input report length
-    uint16_t report_len = get16_le_next();
-    if (report_len != _dev_desc.input_report_len) {
-        NUBRICK_ERROR_RETURN_FALSE("Length of input report doesn't match\r\n");
+    // Validate once against layout, then encode unchecked
+    if ((2 + report_fields_length(_output_report_fields, _num_output_report_fields)) != _dev_desc.output_report_len) {
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_LengthMismatch, "Length of output report doesn't match\r\n");
     }
-
-    // Un-serialize fields from input report
-    NuBrickField *field = _input_report_fields;
-    NuBrickField *field_end = _input_report_fields + _num_input_report_fields;
-    for (; field != field_end; field ++) {
-        if (! unserialize_field_from_report(field)) {
-            NUBRICK_ERROR_RETURN_FALSE("unserialize_field_from_report() failed\r\n");
-        }
+    if (! cursor.require(_dev_desc.output_report_len)) {
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_BufferOverflow, "Frame buffer too small\r\n");
     }
     
-    return true;
-}
-    
-bool NuBrickMaster::serialize_output_report(void) {
-    
-    uint8_t *i2c_buf_beg = _i2c_buf_pos;
-    
     // Output report length
-    set16_le_next(_dev_desc.output_report_len);
+    cursor.set16_le(_dev_desc.output_report_len);
 
     // Serialize fields to output report
     NuBrickField *field = _output_report_fields;
     NuBrickField *field_end = _output_report_fields + _num_output_report_fields;
     for (; field != field_end; field ++) {
-        if (! serialize_field_to_report(field)) {
-            NUBRICK_ERROR_RETURN_FALSE("serialize_field_to_report() failed\r\n");
+        uint16_t value = values ? values[field - _output_report_fields] : field->_value;
+        if (! serialize_field_to_report(cursor, field, value)) {
+            NUBRICK_ERROR_RETURN_FALSE(_last_error, "serialize_field_to_report() failed\r\n");
         }
     }
     
-    if ((_i2c_buf_pos - i2c_buf_beg) != _dev_desc.output_report_len) {
-        NUBRICK_ERROR_RETURN_FALSE("Length of output report doesn't match\r\n");
-    }
-    
     return true;
 }
     
-bool NuBrickMaster::unserialize_feature_report(void) {
+bool NuBrickMaster::serialize_feature_report(NuBrickCursor &cursor, const uint16_t *values) {
     
-    // Feature report length
-    uint16_t report_len = get16_le_next();
-    if (report_len != _dev_desc.getfeat_report_len) {
-        NUBRICK_ERROR_RETURN_FALSE("Length of feature report doesn't match\r\n");
+    // Validate once against layout, then encode unchecked
+    if ((2 + report_fields_length(_feature_report_fields, _num_feature_report_fields)) != _dev_desc.setfeat_report_len) {
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_LengthMismatch, "Length of set feature report doesn't match\r\n");
+    }
+    if (! cursor.require(_dev_desc.setfeat_report_len)) {
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_BufferOverflow, "Frame buffer too small\r\n");
     }
     
-    // Un-serialize fields from feature report
+    // Feature report length
+    cursor.set16_le(_dev_desc.setfeat_report_len);
+
+    // Serialize fields to feature report
     NuBrickField *field = _feature_report_fields;
     NuBrickField *field_end = _feature_report_fields + _num_feature_report_fields;
     for (; field != field_end; field ++) {
-        if (! unserialize_field_from_report(field)) {
-            NUBRICK_ERROR_RETURN_FALSE("unserialize_field_from_report() failed\r\n");
+        uint16_t value = values ? values[field - _feature_report_fields] : field->_value;
+        if (! serialize_field_to_report(cursor, field, value)) {
+            NUBRICK_ERROR_RETURN_FALSE(_last_error, "serialize_field_to_report() failed\r\n");
         }
     }
     
     return true;
 }
+
+NuBrickError NuBrickMaster::validate_report_desc(const NuBrickCursor &cursor) const {
     
-bool NuBrickMaster::serialize_feature_report(void) {
+    const unsigned num_fields_arr[] = {
+        _num_feature_report_fields,
+        _num_input_report_fields,
+        _num_output_report_fields
+    };
     
-    uint8_t *i2c_buf_beg = _i2c_buf_pos;
+    // Report descriptor length
+    unsigned length = 2;
     
-    // Feature report length
-    set16_le_next(_dev_desc.setfeat_report_len);
-
-    // Serialize fields to feature report
-    NuBrickField *field = _feature_report_fields;
-    NuBrickField *field_end = _feature_report_fields + _num_feature_report_fields;
-    for (; field != field_end; field ++) {
-        if (! serialize_field_to_report(field)) {
-            NUBRICK_ERROR_RETURN_FALSE("serialize_field_to_report() failed\r\n");
+    unsigned i, j;
+    for (i = 0; i < sizeof (num_fields_arr) / sizeof (num_fields_arr[0]); i ++) {
+        // Same early out as unserialize_report_desc()
+        if (! num_fields_arr[i]) {
+            break;
+        }
+        
+        // Descriptor type
+        length += 2;
+        
+        for (j = 0; j < num_fields_arr[i]; j ++) {
+            // Field index, field length, minimum tag
+            if (! cursor.require(length + 3)) {
+                return NuBrick_Error_LengthMismatch;
+            }
+            switch (cursor.peek8(length + 2)) {
+                case NuBrick_ReportDesc_Min_Plus1:
+                    length += 3 + 1;
+                    break;
+                    
+                case NuBrick_ReportDesc_Min_Plus2:
+                    length += 3 + 2;
+                    break;
+                    
+                default:
+                    return NuBrick_Error_FieldRange;
+            }
+            
+            // Maximum tag
+            if (! cursor.require(length + 1)) {
+                return NuBrick_Error_LengthMismatch;
+            }
+            switch (cursor.peek8(length)) {
+                case NuBrick_ReportDesc_Max_Plus1:
+                    length += 1 + 1;
+                    break;
+                    
+                case NuBrick_ReportDesc_Max_Plus2:
+                    length += 1 + 2;
+                    break;
+                    
+                default:
+                    return NuBrick_Error_FieldRange;
+            }
         }
     }
     
-    if ((_i2c_buf_pos - i2c_buf_beg) != _dev_desc.setfeat_report_len) {
-        NUBRICK_ERROR_RETURN_FALSE("Length of set feature report doesn't match\r\n");
+    if (! cursor.require(length)) {
+        return NuBrick_Error_LengthMismatch;
     }
     
-    return true;
+    return NuBrick_Error_None;
 }
 
-bool NuBrickMaster::unserialize_field_from_report_desc(NuBrickField *field) {
+bool NuBrickMaster::unserialize_field_from_report_desc(NuBrickCursor &cursor, NuBrickField *field) {
     // Number/length of the field
-    uint8_t field_index = get8_next();
+    uint8_t field_index = cursor.get8();
     if (field_index != field->_field_index) {
-        NUBRICK_ERROR_RETURN_FALSE("Expect field index %d, but %d received\r\n", field->_field_index, field_index);
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_FieldIndex, "Expect field index %d, but %d received\r\n", field->_field_index, field_index);
     }
     
     // Length of the field
-    field->_length = get8_next();
+    field->_length = cursor.get8();
     if (field->_length != 1 && field->_length != 2) {
-        NUBRICK_ERROR_RETURN_FALSE("Expect field length 1/2, but %d received\r\n", field->_length);
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_FieldLength, "Expect field length 1/2, but %d received\r\n", field->_length);
     }
     
     // Minimum of the field
-    uint8_t min = get8_next();
+    uint8_t min = cursor.get8();
     switch (min) {
         case NuBrick_ReportDesc_Min_Plus1:
-            field->_minimum = get8_next();
+            field->_minimum = cursor.get8();
             break;
         
         case NuBrick_ReportDesc_Min_Plus2:
-            field->_minimum = get16_le_next();
+            field->_minimum = cursor.get16_le();
             break;
             
         default:
-            NUBRICK_ERROR_RETURN_FALSE("Expect field minimum %d/%d, but %d received\r\n", NuBrick_ReportDesc_Min_Plus1, NuBrick_ReportDesc_Min_Plus2, min);
+            NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_FieldRange, "Expect field minimum %d/%d, but %d received\r\n", NuBrick_ReportDesc_Min_Plus1, NuBrick_ReportDesc_Min_Plus2, min);
     }
     
     // Maximum of the field
-    uint8_t max = get8_next();
+    uint8_t max = cursor.get8();
     switch (max) {
         case NuBrick_ReportDesc_Max_Plus1:
-            field->_maximum = get8_next();
+            field->_maximum = cursor.get8();
             break;
         
         case NuBrick_ReportDesc_Max_Plus2:
-            field->_maximum = get16_le_next();
+            field->_maximum = cursor.get16_le();
             break;
             
         default:
-            NUBRICK_ERROR_RETURN_FALSE("Expect field maximum %d/%d, but %d received\r\n", NuBrick_ReportDesc_Max_Plus1, NuBrick_ReportDesc_Max_Plus2, max);
+            NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_FieldRange, "Expect field maximum %d/%d, but %d received\r\n", NuBrick_ReportDesc_Max_Plus1, NuBrick_ReportDesc_Max_Plus2, max);
     }
     
-    return true;
-}
-
-bool NuBrickMaster::unserialize_field_from_report(NuBrickField *field) {
-    // Value of the field
-    switch (field->_length) {
-        case 1:
-            field->_value = get8_next();
-            break;
-            
-        case 2:
-            field->_value = get16_le_next();
-            break;
-            
-        default:
-            NUBRICK_ERROR_RETURN_FALSE("Expect field length 1/2, but %d received\r\n", field->_length);
-    }
+    // Pre-compute scale factor for normalization
+    field->update_norm_scale();
     
     return true;
 }
 
-bool NuBrickMaster::serialize_field_to_report(const NuBrickField *field) {
+bool NuBrickMaster::serialize_field_to_report(NuBrickCursor &cursor, const NuBrickField *field, uint16_t value) {
     // Value of the field
     switch (field->_length) {
         case 1:
-            set8_next(field->_value);
+            cursor.set8(value);
             break;
             
         case 2:
-            set16_le_next(field->_value);
+            cursor.set16_le(value);
             break;
             
         default:
-            NUBRICK_ERROR_RETURN_FALSE("Expect field length 1/2, but %d received\r\n", field->_length);
+            NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_FieldLength, "Expect field length 1/2, but %d received\r\n", field->_length);
     }
     
     return true;
 }
 
-uint8_t NuBrickMaster::get8_next(void) {
-    NUBRICK_CHECK_GETN_NEXT(1);
-    
-    uint8_t val = *_i2c_buf_pos ++;
-    return val;
-}
-    
-void NuBrickMaster::set8_next(uint8_t val) {
-    NUBRICK_CHECK_SETN_NEXT(1);
+unsigned NuBrickMaster::report_fields_length(const NuBrickField *fields, unsigned num_fields) {
     
-    *_i2c_buf_pos ++ = val;
-}
-    
-uint16_t NuBrickMaster::get16_le_next(void) {
-    NUBRICK_CHECK_GETN_NEXT(2);
+    unsigned length = 0;
+    unsigned i;
+    for (i = 0; i < num_fields; i ++) {
+        length += fields[i]._length;
+    }
     
-    uint16_t val = nu_get16_le(_i2c_buf_pos);
-    _i2c_buf_pos += 2;
-    return val;
+    return length;
 }
     
-void NuBrickMaster::set16_le_next(uint16_t val) {
-    NUBRICK_CHECK_SETN_NEXT(2);
-    
-    nu_set16_le(_i2c_buf_pos, val);
-    _i2c_buf_pos += 2;
-}
+void NuBrickMaster::print_report(const NuBrickReportSnapshot &report, const char *report_name) {
     
-uint16_t NuBrickMaster::get16_be_next(void) {
-    NUBRICK_CHECK_GETN_NEXT(2);
+    printf("Number of fields of %s\t%d\r\n", report_name, report.num_fields);
     
-    uint16_t val = nu_get16_be(_i2c_buf_pos);
-    _i2c_buf_pos += 2;
-    return val;
+    unsigned i;
+    for (i = 0; i < report.num_fields; i ++) {
+        const NuBrickFieldSnapshot &field = report.fields[i];
+        
+        printf("Name\t\t%s\r\n", field.name);
+        printf("Length\t\t%d\r\n", field.length);
+        printf("Value\t\t%d\r\n", field.value);
+        printf("Minimum\t\t%d\r\n", field.minimum);
+        printf("Maximum\t\t%d\r\n", field.maximum);
+        printf("\r\n");
+    }
 }
+
+void NuBrickMaster::snapshot_report(const NuBrickField *fields, unsigned num_fields, NuBrickReportSnapshot &report) {
     
-void NuBrickMaster::print_report(NuBrickField *fields, unsigned num_fields, const char *report_name) {
-    
-    printf("Number of fields of %s\t%d\r\n", report_name, num_fields);
+    if (num_fields > NUBRICK_MAX_SNAPSHOT_FIELDS) {
+        num_fields = NUBRICK_MAX_SNAPSHOT_FIELDS;
+    }
+    report.num_fields = num_fields;
     
     unsigned i;
     for (i = 0; i < num_fields; i ++) {
-        NuBrickField *field = fields + i;
-        
-        printf("Name\t\t%s\r\n", field->_name);
-        printf("Length\t\t%d\r\n", field->_length);
-        printf("Value\t\t%d\r\n", field->_value);
-        printf("Minimum\t\t%d\r\n", field->_minimum);
-        printf("Maximum\t\t%d\r\n", field->_maximum);
-        printf("\r\n");
+        report.fields[i].name = fields[i]._name;
+        report.fields[i].length = fields[i]._length;
+        report.fields[i].value = fields[i]._value;
+        report.fields[i].minimum = fields[i]._minimum;
+        report.fields[i].maximum = fields[i]._maximum;
     }
 }
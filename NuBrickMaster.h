@@ -19,26 +19,33 @@
 #include "mbed.h"
 #include "mbed_debug.h"
 #include "NuBrickField.h"
+#include "NuBrickCursor.h"
+#include "NuBrickI2CMux.h"
+#include "NuBrickTransport.h"
+#include "NuBrickRecorder.h"
+#include "NuBrickTrace.h"
+#include "NuBrickSerializer.h"
+#include "NuBrickLog.h"
 #include "nubrick_prot.h"
 #include "targets/TARGET_NUVOTON/nu_bitutil.h"
 
-/** Print error message and return null field
+/** Record error code, defer error message, and return null field
  *
  *  @note For internal use
  */
-#define NUBRICK_ERROR_RETURN_NULL_FIELD(...)                \
+#define NUBRICK_ERROR_RETURN_NULL_FIELD(CODE, ...)          \
     do {                                                    \
-        debug_if(_debug, __VA_ARGS__);                      \
+        record_error(CODE, NULL, __VA_ARGS__);              \
         return _null_field;                                 \
     } while (0);
 
-/** Print error message and return false
+/** Record error code, defer error message, and return false
  *
  *  @note For internal use
  */
-#define NUBRICK_ERROR_RETURN_FALSE(...)                     \
+#define NUBRICK_ERROR_RETURN_FALSE(CODE, ...)               \
     do {                                                    \
-        debug_if(_debug, __VA_ARGS__);                      \
+        record_error(CODE, NULL, __VA_ARGS__);              \
         return false;                                       \
     } while (0);
 
@@ -49,32 +56,135 @@
 #define NUBRICK_CHECK_CONNECT()                                                                     \
     do {                                                                                            \
         if (! _connected) {                                                                         \
-            NUBRICK_ERROR_RETURN_FALSE("NuMaker Brick I2C slave module not connected yet!!!\r\n");  \
+            NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_NotConnected,                                  \
+                "NuMaker Brick I2C slave module not connected yet!!!\r\n");                         \
         }                                                                                           \
     } while (0);
     
-/** Check if I2C buffer is overflow on getN calls
+/** Check if NuMaker Brick I2C slave module is healthy, failing fast without bus access if degraded
  *
  *  @note For internal use
  */
-#define NUBRICK_CHECK_GETN_NEXT(N)                                      \
-    do {                                                                \
-        if ((_i2c_buf_pos + N) > _i2c_buf_end) {                        \
-            error("%s:%s: I2C buffer overflow", __FILE__, __func__);    \
-            return 0;                                                   \
-        }                                                               \
+#define NUBRICK_CHECK_HEALTHY()                                                                     \
+    do {                                                                                            \
+        if (_health == NuBrick_Health_Degraded) {                                                   \
+            NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_Degraded,                                      \
+                "NuMaker Brick I2C slave module degraded\r\n");                                     \
+        }                                                                                           \
     } while (0);
 
-/** Check if I2C buffer is overflow on setN calls
+/** Maximum number of input field subscriptions per NuBrickMaster object
+ */
+#ifndef NUBRICK_MAX_SUBSCRIPTIONS
+#define NUBRICK_MAX_SUBSCRIPTIONS       4
+#endif
+
+/** Maximum number of input report observers per NuBrickMaster object
+ */
+#ifndef NUBRICK_MAX_INPUT_OBSERVERS
+#define NUBRICK_MAX_INPUT_OBSERVERS     4
+#endif
+
+/** Maximum number of fields per report, bound by 32-bit field masks
+ */
+#define NUBRICK_MAX_REPORT_FIELDS       32
+
+/** Default poll interval of input report in ms
+ */
+#ifndef NUBRICK_POLL_INTERVAL_DEFAULT
+#define NUBRICK_POLL_INTERVAL_DEFAULT   100
+#endif
+
+/** Default number of consecutive failed transactions to mark NuMaker Brick I2C slave module degraded
+ */
+#ifndef NUBRICK_DEGRADE_THRESHOLD
+#define NUBRICK_DEGRADE_THRESHOLD       3
+#endif
+
+/** Number of log2 buckets of transaction latency histogram
  *
- *  @note For internal use
+ *  @note Bucket i counts latency in [2^i, 2^(i+1)) us. Bucket 0 also counts 0 us and the last bucket
+ *        counts everything above.
  */
-#define NUBRICK_CHECK_SETN_NEXT(N)                                  \
-    do {                                                            \
-        if ((_i2c_buf_pos + N) > _i2c_buf_end) {                    \
-            error("%s: I2C buffer overflow", __func__);             \
-        }                                                           \
-    } while (0);
+#ifndef NUBRICK_LATENCY_BUCKETS
+#define NUBRICK_LATENCY_BUCKETS         16
+#endif
+
+/** Enable lock contention tracing of the NuBrickMaster mutex
+ *
+ *  @note Costs two us ticker reads per lock/unlock pair when enabled. Compiled out by default.
+ */
+#ifndef NUBRICK_LOCK_TRACE
+#define NUBRICK_LOCK_TRACE              0
+#endif
+
+/** Maximum number of (brick, method) lock holders tracked by lock contention tracing
+ */
+#ifndef NUBRICK_LOCK_TRACE_HOLDERS
+#define NUBRICK_LOCK_TRACE_HOLDERS      16
+#endif
+
+/** Number of NuBrick_Comm commands tracked by transaction statistics
+ */
+#define NUBRICK_NUM_COMMS               (NuBrick_Comm_SetFeatureReport + 1)
+
+/** Transaction statistics of one command
+ */
+struct NuBrickCommStats {
+    uint32_t    calls;                                  // Number of transactions
+    uint32_t    failures;                               // Number of failed transactions (nack)
+    uint32_t    bytes;                                  // Bytes written and read, command included
+    uint32_t    latency_max;                            // Maximum latency in us
+    uint64_t    latency_total;                          // Total latency in us, divided by calls for mean
+    uint32_t    latency_hist[NUBRICK_LATENCY_BUCKETS];  // Latency histogram in log2 us buckets
+};
+
+/** Transaction statistics of one NuBrickMaster object, indexed by NuBrick_Comm
+ *
+ *  @note Index NuBrick_Comm_None counts transactions not led by a command
+ */
+struct NuBrickTransactionStats {
+    NuBrickCommStats    comm[NUBRICK_NUM_COMMS];
+};
+
+class NuBrickMaster;
+
+/** Health of NuMaker Brick I2C slave module
+ */
+enum NuBrick_Health {
+    NuBrick_Health_Healthy          = 0,
+    NuBrick_Health_Degraded         = 1,    // Consecutive failures. Bus methods fail fast until probe() succeeds.
+};
+
+/** Lock statistics of one (brick, method) lock holder
+ */
+struct NuBrickLockHolder {
+    const NuBrickMaster *   master;                         // Brick holding the lock, identity only as it may be gone
+    int                     i2c_addr;                       // I2C address of the brick, recorded with the entry
+    const char *            method;                         // Method holding the lock
+    uint32_t                count;                          // Number of acquisitions
+    uint32_t                wait_max;                       // Maximum wait time in us
+    uint64_t                wait_total;                     // Total wait time in us
+    uint32_t                hold_max;                       // Maximum hold time in us
+    uint64_t                hold_total;                     // Total hold time in us
+};
+
+/** Lock contention statistics of the NuBrickMaster mutex
+ *
+ *  @note Only outermost acquisitions are counted. Nested ones of the recursive mutex never wait.
+ */
+struct NuBrickLockStats {
+    uint32_t                acquisitions;                   // Number of acquisitions
+    uint32_t                wait_max;                       // Maximum wait time in us
+    const NuBrickMaster *   wait_max_master;                // Brick having waited the maximum, identity only as it may be gone
+    int                     wait_max_i2c_addr;              // I2C address of the brick having waited the maximum
+    const char *            wait_max_method;                // Method having waited the maximum
+    uint32_t                wait_hist[NUBRICK_LATENCY_BUCKETS]; // Wait time histogram in log2 us buckets
+    uint32_t                hold_hist[NUBRICK_LATENCY_BUCKETS]; // Hold time histogram in log2 us buckets
+    uint32_t                holders_dropped;                // Acquisitions not attributed with holder table full
+    unsigned                num_holders;                    // Number of valid entries in holders
+    NuBrickLockHolder       holders[NUBRICK_LOCK_TRACE_HOLDERS];    // Sorted by total hold time, top first
+};
     
 /** A NuMaker Brick I2C master, used for communicating with NuMaker Brick I2C slave modules
  *
@@ -85,6 +195,20 @@ class NuBrickMaster {
 
 public:
 
+    /** Callback type of field subscription
+     *
+     *  @note Invoked with the lock held, in context of the thread calling pull_input_report()
+     */
+    typedef mbed::Callback<void(NuBrickField &field)> FieldCallback;
+    
+    /** Callback type of input report observer
+     *
+     *  @note Invoked with the lock held, in context of the thread calling pull_input_report()
+     *        or pull_input_fields(). pulled_mask tells which input fields the pull refreshed:
+     *        all of them on pull_input_report(), the requested ones on pull_input_fields().
+     */
+    typedef mbed::Callback<void(NuBrickMaster &master, uint32_t pulled_mask, uint32_t changed_mask)> ReportCallback;
+
     /** Create an I2C interface, connected to the specified pins
      *
      *  @param i2c I2C object
@@ -121,6 +245,109 @@ public:
      */
     NuBrickField &operator[](const char *report_field_name);
     
+    /** Subscribe to changes of one input field in "report.field" format, e.g. "input.key_state"
+     *
+     *  @param report_field_name name of the input field
+     *  @param cb callback invoked with the changed field
+     *  @param deadband minimum change of value since last notification to notify again
+     *  @return subscription handle if success, -1 if failure
+     *
+     *  @note Only input report fields are supported. Subscribers are notified after pull_input_report()
+     *        only when the field has changed by more than deadband.
+     */
+    int subscribe(const char *report_field_name, FieldCallback cb, uint16_t deadband = 0);
+    
+    /** Subscribe to changes of one input field with thread flags
+     *
+     *  @param report_field_name name of the input field
+     *  @param thread_id thread to signal
+     *  @param flags thread flags to set on change
+     *  @param deadband minimum change of value since last notification to notify again
+     *  @return subscription handle if success, -1 if failure
+     */
+    int subscribe(const char *report_field_name, osThreadId_t thread_id, uint32_t flags, uint16_t deadband = 0);
+    
+    /** Cancel subscription
+     *
+     *  @param handle subscription handle returned by subscribe()
+     *  @return true if success, false if failure
+     */
+    bool unsubscribe(int handle);
+    
+    /** Add observer of every input report pulled in, whether changed or not
+     *
+     *  @param cb callback invoked with bitmasks of pulled and changed input fields
+     *  @return observer handle if success, -1 if failure
+     */
+    int add_input_observer(ReportCallback cb);
+    
+    /** Remove observer of input report
+     *
+     *  @param handle observer handle returned by add_input_observer()
+     *  @return true if success, false if failure
+     */
+    bool remove_input_observer(int handle);
+    
+    /** Get values of all input fields at once, e.g. to capture a batch of input reports
+     *
+     *  @param values array to receive values, in order of input fields
+     *  @param max_values size of values
+     *  @return number of values got
+     */
+    unsigned get_input_values(uint16_t *values, unsigned max_values);
+    
+    /** Get local values of all feature fields at once, e.g. as base of build_feature_frame()
+     *
+     *  @param values array to receive values, in order of feature fields
+     *  @param max_values size of values
+     *  @return number of values got
+     */
+    unsigned get_feature_values(uint16_t *values, unsigned max_values);
+    
+    /** Get local values of all output fields at once, e.g. as base of build_output_frame()
+     *
+     *  @param values array to receive values, in order of output fields
+     *  @param max_values size of values
+     *  @return number of values got
+     */
+    unsigned get_output_values(uint16_t *values, unsigned max_values);
+    
+    /** Set local values of selected feature fields at once, e.g. to commit a frame pushed with push_frame()
+     *
+     *  @param values values in order of feature fields
+     *  @param num_values size of values
+     *  @param field_mask fields to set with bit N for the Nth feature field
+     */
+    void set_feature_values(const uint16_t *values, unsigned num_values, uint32_t field_mask);
+    
+    /** Set local values of selected output fields at once, e.g. to commit a frame pushed with push_frame()
+     *
+     *  @param values values in order of output fields
+     *  @param num_values size of values
+     *  @param field_mask fields to set with bit N for the Nth output field
+     */
+    void set_output_values(const uint16_t *values, unsigned num_values, uint32_t field_mask);
+    
+    /** Get bitmask of input fields changed by the last pull_input_report()
+     *
+     *  @return changed fields with bit N for the Nth input field
+     *
+     *  @note Use get_field_mask() to get the bit of a specific field.
+     */
+    uint32_t get_input_changed_mask(void);
+    
+    /** Get bitmask bit of one field in "report.field" format, e.g. "input.key_state"
+     *
+     *  @return field bit if success, 0 if failure
+     */
+    uint32_t get_field_mask(const char *report_field_name);
+    
+    /** Get position of one field in its report, in "report.field" format, e.g. "feature.color"
+     *
+     *  @return position if success, -1 if failure
+     */
+    int get_field_position(const char *report_field_name);
+    
     /** Pull device descriptor from the NuBrick I2C slave module
      *
      *  @return true if success, false if failure
@@ -138,6 +365,86 @@ public:
      *  @return true if success, false if failure
      */
     bool pull_input_report(void);
+    
+    /** Pull input report, getting the error of this call
+     *
+     *  @param error receives error of this call, NuBrick_Error_None if success
+     *  @return true if success, false if failure
+     *
+     *  @note Unlike get_last_error(), error is not overwritten by failures of other threads.
+     */
+    bool pull_input_report(NuBrickError &error);
+    
+    /** Pull only leading part of input report covering the requested fields
+     *
+     *  @param field_mask requested input fields with bit N for the Nth input field
+     *  @return true if success, false if failure
+     *
+     *  @note The read ends right after the last requested field, so bus time is cut for hot
+     *        fields at the front of the report, e.g. "input.distance" on Sonar. Only requested
+     *        fields get updated, along with their age (see NuBrickField::get_age()).
+     *        Use get_field_mask() to get the bit of a specific field.
+     */
+    bool pull_input_fields(uint32_t field_mask);
+
+    /** Configure adaptive polling of input report
+     *
+     *  @param min_interval_ms shortest poll interval in ms, used on signal activity
+     *  @param max_interval_ms longest poll interval in ms, backed off to while signal stays constant
+     *  @return true if success, false if failure
+     *
+     *  @note Poll interval defaults to NUBRICK_POLL_INTERVAL_DEFAULT with no adaption.
+     */
+    bool set_adaptive_poll(uint32_t min_interval_ms, uint32_t max_interval_ms);
+    
+    /** Pull input report from the NuBrick I2C slave module and adapt poll interval
+     *
+     *  @return true if success, false if failure
+     *
+     *  @note Poll interval drops to minimum when an over flag is set, halves when the input report
+     *        changes, and doubles up to maximum when the input report stays the same.
+     *        Call this function again after get_poll_interval().
+     */
+    bool pull_input_report_adaptive(void);
+    
+    /** Get current poll interval of input report in ms
+     */
+    uint32_t get_poll_interval(void);
+    
+    /** Get effective poll rate of input report in mHz, measured over pull_input_report_adaptive() calls
+     */
+    uint32_t get_poll_rate(void);
+    
+    /** Get health of the NuBrick I2C slave module
+     */
+    NuBrick_Health get_health(void);
+    
+    /** Set number of consecutive failed transactions to mark the NuBrick I2C slave module degraded
+     *
+     *  @return true if success, false if failure
+     */
+    bool set_degrade_threshold(unsigned threshold);
+    
+    /** Probe degraded NuBrick I2C slave module and revalidate its descriptors
+     *
+     *  @return true if healthy again, false if failure
+     *
+     *  @details Pulls device descriptor, which must equal the one got on connect(), then pulls
+     *           report descriptor, which must match the fields. On success, the module gets
+     *           healthy again and the next input report counts as all changed.
+     */
+    bool probe(void);
+    
+    /** Snapshot transaction statistics per command
+     *
+     *  @param stats receives the snapshot
+     *  @param reset true to reset statistics atomically with the snapshot
+     */
+    void get_transaction_stats(NuBrickTransactionStats &stats, bool reset = false);
+    
+    /** Reset transaction statistics
+     */
+    void reset_transaction_stats(void);
 
     /** Push output report to the NuBrick I2C slave module
      *
@@ -145,18 +452,167 @@ public:
      */
     bool push_output_report(void);
     
+    /** Push output report, getting the error of this call as with pull_input_report(NuBrickError &)
+     */
+    bool push_output_report(NuBrickError &error);
+    
     /** Pull feature report from the NuBrick I2C slave module
      *
      *  @return true if success, false if failure
      */
     bool pull_feature_report(void);
     
+    /** Pull feature report, getting the error of this call as with pull_input_report(NuBrickError &)
+     */
+    bool pull_feature_report(NuBrickError &error);
+    
     /** Push feature report to the NuBrick I2C slave module
      *
      *  @return true if success, false if failure
      */
     bool push_feature_report(void);
     
+    /** Push feature report, getting the error of this call as with pull_input_report(NuBrickError &)
+     */
+    bool push_feature_report(NuBrickError &error);
+    
+    /** Serialize feature report from local fields into a frame, to push later as is with push_frame()
+     *
+     *  @param frame buffer to receive the frame
+     *  @param size size of frame
+     *  @return length of the frame if success, 0 if failure
+     */
+    unsigned build_feature_frame(uint8_t *frame, unsigned size);
+    
+    /** Serialize feature report from given values into a frame, leaving local fields untouched
+     *
+     *  @param values values of all feature fields, in order of feature fields
+     *  @param num_values number of values, must be number of feature fields
+     *  @param frame buffer to receive the frame
+     *  @param size size of frame
+     *  @return length of the frame if success, 0 if failure
+     */
+    unsigned build_feature_frame(const uint16_t *values, unsigned num_values, uint8_t *frame, unsigned size);
+    
+    /** Serialize output report from local fields into a frame, to push later as is with push_frame()
+     *
+     *  @param frame buffer to receive the frame
+     *  @param size size of frame
+     *  @return length of the frame if success, 0 if failure
+     */
+    unsigned build_output_frame(uint8_t *frame, unsigned size);
+    
+    /** Serialize output report from given values into a frame, leaving local fields untouched
+     *
+     *  @param values values of all output fields, in order of output fields
+     *  @param num_values number of values, must be number of output fields
+     *  @param frame buffer to receive the frame
+     *  @param size size of frame
+     *  @return length of the frame if success, 0 if failure
+     */
+    unsigned build_output_frame(const uint16_t *values, unsigned num_values, uint8_t *frame, unsigned size);
+    
+    /** Push frame built by build_feature_frame()/build_output_frame() to the NuBrick I2C slave module
+     *
+     *  @return true if success, false if failure
+     *
+     *  @note Local fields are not updated. No serialization is involved.
+     */
+    bool push_frame(const uint8_t *frame, unsigned length);
+    
+    /** Push frame, getting the error of this call as with pull_input_report(NuBrickError &)
+     */
+    bool push_frame(const uint8_t *frame, unsigned length, NuBrickError &error);
+    
+    /** Route bus transactions through transport instead of the I2C object
+     *
+     *  @param transport transport, e.g. NuBrickReplayTransport, or NULL to restore the I2C object
+     */
+    void attach_transport(NuBrickTransport *transport);
+    
+    /** Record bus transactions
+     *
+     *  @param recorder recorder, or NULL to stop recording
+     */
+    void attach_recorder(NuBrickRecorder *recorder);
+    
+    /** Trace bus transfers into a binary ring
+     *
+     *  @param trace trace ring, or NULL to stop tracing
+     */
+    void attach_trace(NuBrickTrace *trace);
+    
+    /** Put the NuBrick I2C slave module behind a channel of I2C mux
+     *
+     *  @param mux I2C mux on the same I2C object, or NULL if on the bus directly
+     *  @param channel mux channel 0~7
+     *  @return true if success, false if failure
+     *
+     *  @note The channel is selected with the bus lock held on each transaction. The mux write
+     *        counts as part of the transaction, goes through an attached transport and shows
+     *        in trace and recording. Channels of other muxes on the bus get closed first, and
+     *        a module on the bus directly closes all of them (see NuBrickI2CMux).
+     */
+    bool attach_mux(NuBrickI2CMux *mux, int channel);
+    
+    /** Get I2C mux the NuBrick I2C slave module is behind, NULL if none
+     */
+    NuBrickI2CMux *get_mux(void) {
+        return _mux;
+    }
+    
+    /** Get I2C mux channel the NuBrick I2C slave module is behind, -1 if none
+     */
+    int get_mux_channel(void) {
+        return _mux ? _mux_channel : -1;
+    }
+    
+    /** Get 8-bit I2C slave address of the NuBrick I2C slave module
+     */
+    int get_i2c_addr(void) {
+        return _i2c_addr;
+    }
+    
+    /** Snapshot lock contention statistics of the NuBrickMaster mutex, shared by all bricks
+     *
+     *  @param stats receives the snapshot
+     *  @param reset true to reset statistics atomically with the snapshot
+     *  @return true if success, false if NUBRICK_LOCK_TRACE is not enabled
+     */
+    static bool get_lock_stats(NuBrickLockStats &stats, bool reset = false);
+    
+    /** Print lock contention statistics of the NuBrickMaster mutex
+     */
+    static bool print_lock_stats(void);
+    
+    /** Get error code of the most recent failure
+     *
+     *  @note Error messages are deferred to NuBrickLog, printed only with debug enabled and
+     *        NuBrickLog draining
+     */
+    NuBrickError get_last_error(void);
+    
+    /** Take a consistent snapshot of device descriptor and reports
+     *
+     *  @param snapshot receives the snapshot
+     *  @return true if success, false if failure
+     *
+     *  @note Only copying is done under the lock. Serialize outside it with NuBrickSerializer.
+     */
+    bool snapshot(NuBrickSnapshot &snapshot);
+    
+    /** Serialize device descriptor and reports into JSON, null-terminated
+     *
+     *  @return length of JSON text if success, 0 if failure
+     */
+    size_t serialize_json(char *buf, size_t size);
+    
+    /** Serialize device descriptor and reports into CBOR
+     *
+     *  @return length of CBOR data if success, 0 if failure
+     */
+    size_t serialize_cbor(uint8_t *buf, size_t size);
+    
     /** Print device descriptor
      */
     bool print_device_desc(void);
@@ -177,11 +633,17 @@ protected:
     I2C &                               _i2c;
     int                                 _i2c_addr;
     uint8_t                             _i2c_buf[80];
-    uint8_t *                           _i2c_buf_pos;
-    uint8_t * const                     _i2c_buf_end;
-    bool                                _i2c_buf_overflow;
+    NuBrickTransport *                  _transport;
+    NuBrickRecorder *                   _recorder;
+    NuBrickTrace *                      _trace;
+    NuBrickI2CMux *                     _mux;
+    int                                 _mux_channel;
     bool                                _connected;
     bool                                _debug;
+    NuBrickError                        _last_error;
+    NuBrick_Health                      _health;
+    unsigned                            _degrade_threshold;
+    unsigned                            _consecutive_failures;
     NuBrick_Device_Descriptor           _dev_desc;
     NuBrickField                        _null_field;
     NuBrickField *                      _feature_report_fields;
@@ -190,22 +652,268 @@ protected:
     unsigned                            _num_input_report_fields;
     NuBrickField *                      _output_report_fields;
     unsigned                            _num_output_report_fields;
+    uint8_t                             _input_report_prev[sizeof (_i2c_buf)];
+    bool                                _input_report_prev_valid;
+    uint32_t                            _input_pulled_mask;
+    uint32_t                            _input_changed_mask;
+    uint32_t                            _input_alarm_mask;
+    uint32_t                            _poll_interval_min;
+    uint32_t                            _poll_interval_max;
+    uint32_t                            _poll_interval;
+    uint32_t                            _poll_interval_meas;
+    rtos::Kernel::Clock::time_point     _poll_last;
+    NuBrickTransactionStats             _txn_stats;     // With _health, owned by the lock, never the bus lock
+    uint32_t                            _txn_seq;       // Owned by the bus lock
+    uint32_t                            _input_published_seq;
+    uint32_t                            _feature_published_seq;
+    uint32_t                            _layout_seq;    // Bumped on descriptor pull, which may change field lengths
+    
+    /** One bus transaction, private to the transferring thread until accounted
+     */
+    struct Transaction {
+        uint16_t                        comm;
+        bool                            active;
+        bool                            ended;
+        bool                            success;
+        uint32_t                        start;
+        uint32_t                        latency;
+        uint32_t                        bytes;
+    };
+    
+    /** Subscription to changes of one input field
+     */
+    struct Subscription {
+        FieldCallback                   cb;
+        osThreadId_t                    thread_id;
+        uint32_t                        flags;
+        uint16_t                        deadband;
+        uint16_t                        last_value;
+        uint8_t                         field_pos;
+        bool                            used;
+        bool                            notified;
+    };
+    
+    Subscription                        _subscriptions[NUBRICK_MAX_SUBSCRIPTIONS];
+    ReportCallback                      _input_observers[NUBRICK_MAX_INPUT_OBSERVERS];
     
     /** Using RAII idiom for mutex lock/unlock
      */
     class MutexGuard {
     public:
-        MutexGuard() {
+        MutexGuard(const NuBrickMaster *master, const char *method) {
+#if NUBRICK_LOCK_TRACE
+            lock_traced(master, method);
+#else
+            (void) master;
+            (void) method;
             _mutex->lock();
+#endif
         }
         
         ~MutexGuard() {
+#if NUBRICK_LOCK_TRACE
+            unlock_traced();
+#else
             _mutex->unlock();
+#endif
         }
     };
     
     static SingletonPtr<rtos::Mutex>  _mutex;
     
+    /** Using RAII idiom for bus lock/unlock
+     *
+     *  @note The bus lock covers only raw bus transactions, and is never waited on with
+     *        the mutex above held, except for descriptor pulls on connect()/probe().
+     */
+    class BusGuard {
+    public:
+        BusGuard(I2C &i2c) : _i2c(i2c) {
+            _i2c.lock();
+        }
+        
+        ~BusGuard() {
+            _i2c.unlock();
+        }
+        
+    private:
+        I2C &   _i2c;
+    };
+    
+#if NUBRICK_LOCK_TRACE
+    static unsigned                     _lock_depth;
+    static uint32_t                     _lock_start;
+    static uint32_t                     _lock_wait;
+    static const NuBrickMaster *        _lock_master;
+    static int                          _lock_i2c_addr;
+    static const char *                 _lock_method;
+    static NuBrickLockStats             _lock_stats;
+    
+    /** Lock mutex and measure wait time
+     */
+    static void lock_traced(const NuBrickMaster *master, const char *method);
+    
+    /** Measure hold time and unlock mutex
+     */
+    static void unlock_traced(void);
+#endif
+
+    /** Get log2 bucket of time in us
+     */
+    static unsigned log2_bucket(uint32_t time_us);
+    
+    /** Write to the NuBrick I2C slave module through I2C object or attached transport
+     *
+     *  @return 0 on success (ack), non-zero on failure (nack)
+     *
+     *  @note Called with the bus lock held
+     */
+    int bus_write(Transaction &txn, const uint8_t *data, int length, bool repeated);
+    
+    /** Read from the NuBrick I2C slave module through I2C object or attached transport
+     *
+     *  @return 0 on success (ack), non-zero on failure (nack)
+     *
+     *  @note Called with the bus lock held
+     */
+    int bus_read(Transaction &txn, uint8_t *data, int length, bool repeated);
+    
+    /** Send command and receive response in one bus transaction, with only the bus lock
+     *
+     *  @param seq to receive order of the transfer on the bus, or NULL
+     *  @return NuBrick_Error_None if success, error code if failure
+     *
+     *  @note Transaction statistics and health are updated with the lock after the bus lock
+     *        is released
+     */
+    NuBrickError transfer_read(uint16_t comm, uint8_t *data, uint16_t length, uint32_t *seq = NULL);
+    
+    /** Send frame in one bus transaction, with only the bus lock
+     *
+     *  @return NuBrick_Error_None if success, error code if failure
+     *
+     *  @note Transaction statistics and health are updated with the lock after the bus lock
+     *        is released
+     */
+    NuBrickError transfer_write(const uint8_t *data, uint16_t length);
+    
+    /** Isolate the NuBrick I2C slave module on the bus: close channels of other I2C muxes on the bus,
+     *  then select its own channel if behind I2C mux
+     *
+     *  @param comm command of the transaction the mux writes open
+     *  @return true if success, false if failure
+     *
+     *  @note Called with the bus lock held. Mux writes go through the attached transport,
+     *        recorder and trace like any bus access, and a failed one ends the transaction
+     *        as failed.
+     */
+    bool select_mux(Transaction &txn, uint16_t comm);
+    
+    /** Write one I2C mux to channel for select_mux(), if not selected already
+     *
+     *  @note Called with the bus lock held
+     */
+    bool write_mux(Transaction &txn, uint16_t comm, NuBrickI2CMux *mux, int channel);
+    
+    /** Pass one bus access to the attached recorder and trace
+     *
+     *  @note Called with the bus lock held
+     */
+    void record_bus(const Transaction &txn, uint8_t flags, int addr, const uint8_t *data, int length, int rc);
+    
+    /** Decode field values from private copy of report, with no lock
+     *
+     *  @param report report read
+     *  @param report_len full report length, expected in report header
+     *  @param read_len bytes read, less than report_len on partial read
+     *  @param lengths field lengths copied under the lock, in report order
+     *  @param num_fields number of fields to decode, all covered by read_len
+     *  @param values array to receive values
+     *  @return NuBrick_Error_None if success, error code if failure
+     */
+    NuBrickError decode_report(const uint8_t *report, uint16_t report_len, uint16_t read_len, const uint8_t *lengths, unsigned num_fields, uint16_t *values) const;
+    
+    /** Copy field lengths of one report, for decode_report() out of the lock
+     *
+     *  @note Called with the lock held
+     */
+    static void get_field_lengths(const NuBrickField *fields, unsigned num_fields, uint8_t *lengths);
+    
+    /** Publish decoded input report values and compute changed mask
+     *
+     *  @note Called with the lock held
+     */
+    void publish_input_report(const uint8_t *report, uint16_t report_len, const uint16_t *values);
+    
+    /** Publish decoded values of requested input fields from partial read and compute changed mask
+     *
+     *  @note Called with the lock held
+     */
+    void publish_input_fields(const uint8_t *report, uint32_t field_mask, unsigned num_fields, const uint16_t *values);
+    
+    /** Start one transaction of command
+     *
+     *  @note Called with the bus lock held
+     */
+    void begin_transaction(Transaction &txn, uint16_t comm);
+    
+    /** End one transaction, measuring its latency
+     *
+     *  @note Called with the bus lock held
+     */
+    void end_transaction(Transaction &txn, bool success);
+    
+    /** Account one ended transaction into transaction statistics and health
+     *
+     *  @note Takes the lock. Called with the bus lock released.
+     */
+    void account_transaction(const Transaction &txn);
+    
+    /** Is transfer of seq newer than the last published one? If so, mark it published.
+     *
+     *  @note Called with the lock held
+     */
+    static bool publish_seq(uint32_t seq, uint32_t &published_seq);
+    
+    /** Record error code and defer error message to NuBrickLog
+     *
+     *  @param code error code
+     *  @param name name passed as the first argument of fmt, or NULL
+     *  @param fmt format string literal
+     *  @param a0~a2 integer arguments of fmt
+     */
+    void record_error(NuBrickError code, const char *name, const char *fmt, int32_t a0 = 0, int32_t a1 = 0, int32_t a2 = 0);
+    
+    /** Check connected and healthy as NUBRICK_CHECK_CONNECT()/NUBRICK_CHECK_HEALTHY(), returning the error
+     *
+     *  @note Called with the lock held
+     */
+    NuBrickError check_ready(void);
+    
+    /** Serialize feature report into a frame as build_feature_frame(), getting the error of this call
+     */
+    unsigned build_feature_frame(const uint16_t *values, unsigned num_values, uint8_t *frame, unsigned size, NuBrickError &error);
+    
+    /** Serialize output report into a frame as build_output_frame(), getting the error of this call
+     */
+    unsigned build_output_frame(const uint16_t *values, unsigned num_values, uint8_t *frame, unsigned size, NuBrickError &error);
+    
+    /** Look up one field in "report.field" format
+     *
+     *  @return non-NULL if success, NULL if failure
+     */
+    NuBrickField *lookup_field(const char *report_field_name);
+    
+    /** Add a subscription to changes of one input field
+     *
+     *  @return subscription handle if success, -1 if failure
+     */
+    int add_subscription(const char *report_field_name, FieldCallback cb, osThreadId_t thread_id, uint32_t flags, uint16_t deadband);
+    
+    /** Notify observers of the last un-serialized input report and subscribers of input fields changed by it
+     */
+    void notify_subscribers(void);
+    
     /** Add fields of feature report
      */
     void add_feature_fields(const NuBrickField::IndexName *field_index_name, unsigned num_index_name);
@@ -243,75 +951,57 @@ protected:
      *
      *  @return true if success, false if failure
      */
-    bool unserialize_device_desc(void);
+    bool unserialize_device_desc(NuBrickCursor &cursor);
     
     /** Un-serialize report descriptor from the NuBrick I2C slave module
      *
      *  @return true if success, false if failure
      */
-    virtual bool unserialize_report_desc(void);
-    
-    /** Un-serialize input report from the NuBrick I2C slave module
-     *
-     *  @return true if success, false if failure
-     */
-    virtual bool unserialize_input_report(void);
+    virtual bool unserialize_report_desc(NuBrickCursor &cursor);
     
     /** Serialize output report to the NuBrick I2C slave module
      *
+     *  @param values values of all output fields, or NULL for local values
      *  @return true if success, false if failure
      */
-    virtual bool serialize_output_report(void);
-    
-    /** Un-serialize feature report from the NuBrick I2C slave module
-     *
-     *  @return true if success, false if failure
-     */
-    virtual bool unserialize_feature_report(void);
+    virtual bool serialize_output_report(NuBrickCursor &cursor, const uint16_t *values);
     
     /** Serialize feature report to the NuBrick I2C slave module
      *
+     *  @param values values of all feature fields, or NULL for local values
      *  @return true if success, false if failure
      */
-    virtual bool serialize_feature_report(void);
+    virtual bool serialize_feature_report(NuBrickCursor &cursor, const uint16_t *values);
     
-    /** Un-serialize field from report descriptor
-     */
-    bool unserialize_field_from_report_desc(NuBrickField *field);
-    
-    /** Un-serialize field from report
-     */
-    bool unserialize_field_from_report(NuBrickField *field);
-    
-    /** Serialize field to report
-     */
-    bool serialize_field_to_report(const NuBrickField *field);
-    
-    /** Un-serialize from little-endian stream to uint8_t type and advance stream position
-     */
-    uint8_t get8_next(void);
-    
-    /** Serialize from uint8_t type to little-endian stream and advance stream position
+    /** Validate report descriptor length once against its layout, walking only the size tags
+     *
+     *  @return NuBrick_Error_None if valid, error code if malformed
      */
-    void set8_next(uint8_t val);
+    NuBrickError validate_report_desc(const NuBrickCursor &cursor) const;
     
-    /** Un-serialize from little-endian stream to uint16_t type and advance stream position
+    /** Un-serialize field from report descriptor, after validate_report_desc()
      */
-    uint16_t get16_le_next(void);
+    bool unserialize_field_from_report_desc(NuBrickCursor &cursor, NuBrickField *field);
     
-    /** Serialize from uint16_t type to little-endian stream and advance stream position
+    /** Serialize field to report, after length is validated
      */
-    void set16_le_next(uint16_t val);
+    bool serialize_field_to_report(NuBrickCursor &cursor, const NuBrickField *field, uint16_t value);
     
-    /** Un-serialize from big-endian stream to uint16_t type and advance stream position
+    /** Get length of field values of one report, excluding report length
      */
-    uint16_t get16_be_next(void);
+    static unsigned report_fields_length(const NuBrickField *fields, unsigned num_fields);
     
     /** Print specified report
      *
      *  @param name report name
      */
-    void print_report(NuBrickField *fields, unsigned num_fields, const char *report_name);
+    void print_report(const NuBrickReportSnapshot &report, const char *report_name);
+    
+    /** Copy fields of one report into snapshot
+     *
+     *  @note Called with the lock held
+     */
+    static void snapshot_report(const NuBrickField *fields, unsigned num_fields, NuBrickReportSnapshot &report);
 };
 
 #endif
@@ -15,8 +15,8 @@
  */
 #include "NuBrickMasterAHRS.h"
 
-NuBrickMasterAHRS::NuBrickMasterAHRS(I2C &i2c, bool debug) :
-    NuBrickMaster(i2c, NuBrick_I2CAddr_AHRS, debug) {
+NuBrickMasterAHRS::NuBrickMasterAHRS(I2C &i2c, bool debug, int i2c_addr) :
+    NuBrickMaster(i2c, i2c_addr, debug) {
 
     static const NuBrickField::IndexName ahrs_feature_field_index_name_arr[] = {
         NuBrickField::IndexName(NuBrick_ReportDesc_FieldIndex1_Plus1, "sleep_period"),
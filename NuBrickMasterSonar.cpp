@@ -15,8 +15,10 @@
  */
 #include "NuBrickMasterSonar.h"
 
-NuBrickMasterSonar::NuBrickMasterSonar(I2C &i2c, bool debug) :
-    NuBrickMaster(i2c, NuBrick_I2CAddr_Sonar, debug) {
+NuBrickMasterSonar::NuBrickMasterSonar(I2C &i2c, bool debug, int i2c_addr) :
+    NuBrickMaster(i2c, i2c_addr, debug),
+    _filter(Filter_None), _filtered_distance(0), _median_pos(0), _median_count(0),
+    _kalman_x(0), _kalman_p(0), _kalman_q(4 << 4), _kalman_r(64 << 4), _kalman_init(false) {
 
     static const NuBrickField::IndexName sonar_feature_field_index_name_arr[] = {
         NuBrickField::IndexName(NuBrick_ReportDesc_FieldIndex1_Plus1, "sleep_period"),
@@ -38,6 +40,94 @@ NuBrickMasterSonar::NuBrickMasterSonar(I2C &i2c, bool debug) :
         
     // Add fields of output report
     
+    // Filter each input report
+    add_input_observer(mbed::callback(this, &NuBrickMasterSonar::on_input_report));
+    
     // No lock needed in the constructor
 
 }
+
+bool NuBrickMasterSonar::set_filter(Filter filter, uint16_t process_noise, uint16_t measure_noise) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    if (measure_noise == 0) {
+        NUBRICK_ERROR_RETURN_FALSE(NuBrick_Error_InvalidArgument, "Zero measurement noise not support\r\n");
+    }
+    
+    _filter = filter;
+    _median_pos = 0;
+    _median_count = 0;
+    _kalman_q = (uint32_t) process_noise << 4;
+    _kalman_r = (uint32_t) measure_noise << 4;
+    _kalman_init = false;
+    
+    return true;
+}
+
+uint16_t NuBrickMasterSonar::get_filtered_distance(void) {
+    // Support thread-safe
+    MutexGuard guard(this, __func__);
+    
+    return _filtered_distance;
+}
+
+void NuBrickMasterSonar::on_input_report(NuBrickMaster &master, uint32_t pulled_mask, uint32_t changed_mask) {
+    
+    // Filter on every pull of distance, changed or not, so the filters see the real sample rate
+    (void) master;
+    (void) changed_mask;
+    
+    // Partial pull of other fields, distance is not a new sample
+    if (! (pulled_mask & 0x1)) {
+        return;
+    }
+    
+    // "input.distance" is the first input field
+    uint16_t distance = _input_report_fields[0].get_value();
+    
+    switch (_filter) {
+        case Filter_Median: {
+            _median_win[_median_pos] = distance;
+            _median_pos = (_median_pos + 1) % NUBRICK_SONAR_MEDIAN_SIZE;
+            if (_median_count < NUBRICK_SONAR_MEDIAN_SIZE) {
+                _median_count ++;
+            }
+            
+            // Insertion sort on copy of fixed-size window
+            uint16_t sorted[NUBRICK_SONAR_MEDIAN_SIZE];
+            unsigned i, j;
+            for (i = 0; i < _median_count; i ++) {
+                uint16_t val = _median_win[i];
+                for (j = i; j > 0 && sorted[j - 1] > val; j --) {
+                    sorted[j] = sorted[j - 1];
+                }
+                sorted[j] = val;
+            }
+            _filtered_distance = sorted[_median_count / 2];
+            break;
+        }
+            
+        case Filter_Kalman: {
+            int32_t z = (int32_t) distance << 4;
+            
+            if (! _kalman_init) {
+                _kalman_x = z;
+                _kalman_p = _kalman_r;
+                _kalman_init = true;
+            }
+            else {
+                // Predict, then correct with gain in Q16
+                _kalman_p += _kalman_q;
+                uint32_t gain = (uint32_t) (((uint64_t) _kalman_p << 16) / (_kalman_p + _kalman_r));
+                _kalman_x += (int32_t) (((int64_t) (z - _kalman_x) * gain) >> 16);
+                _kalman_p = (uint32_t) (((uint64_t) (0x10000 - gain) * _kalman_p) >> 16);
+            }
+            _filtered_distance = (uint16_t) ((_kalman_x + 8) >> 4);
+            break;
+        }
+            
+        default:
+            _filtered_distance = distance;
+    }
+}
@@ -19,6 +19,11 @@
 #include "mbed.h"
 #include "NuBrickMaster.h"
 
+/** Window size of median filter of NuBrickMasterSonar
+ */
+#ifndef NUBRICK_SONAR_MEDIAN_SIZE
+#define NUBRICK_SONAR_MEDIAN_SIZE       5
+#endif
 
 /** A NuMaker Brick I2C master, used for communicating with NuMaker Brick I2C slave module Sonar
  *
@@ -29,20 +34,66 @@
  *          - feature.distance_AT
  *          - input.distance
  *          - input.over_flag
+ *
+ *          Each pulled input report also runs "input.distance" through the filter chosen by
+ *          set_filter(). Get the result through get_filtered_distance().
  */
 class NuBrickMasterSonar : public NuBrickMaster {
 
 public:
 
+    /** Filter of "input.distance"
+     */
+    enum Filter {
+        Filter_None     = 0,                // No filter
+        Filter_Median   = 1,                // Median over last NUBRICK_SONAR_MEDIAN_SIZE samples
+        Filter_Kalman   = 2,                // 1-D Kalman filter
+    };
+
     /** Create an I2C interface, connected to the specified pins
      *
      *  @param i2c I2C object
+     *  @param i2c_addr 8-bit I2C slave address [ addr | 0 ], overridden e.g. for a second brick of the same type
      */
-    NuBrickMasterSonar(I2C &i2c, bool debug);
+    NuBrickMasterSonar(I2C &i2c, bool debug, int i2c_addr = NuBrick_I2CAddr_Sonar);
 
     virtual ~NuBrickMasterSonar() {
         // Do nothing
     }
+    
+    /** Choose filter of "input.distance"
+     *
+     *  @param filter filter
+     *  @param process_noise process noise variance of Kalman filter, in squared distance units
+     *  @param measure_noise measurement noise variance of Kalman filter, in squared distance units
+     *  @return true if success, false if failure
+     *
+     *  @note Filter state restarts.
+     */
+    bool set_filter(Filter filter, uint16_t process_noise = 4, uint16_t measure_noise = 64);
+    
+    /** Get filtered "input.distance"
+     */
+    uint16_t get_filtered_distance(void);
+    
+protected:
+    Filter                              _filter;
+    uint16_t                            _filtered_distance;
+    uint16_t                            _median_win[NUBRICK_SONAR_MEDIAN_SIZE];
+    unsigned                            _median_pos;
+    unsigned                            _median_count;
+    int32_t                             _kalman_x;      // Estimate in Q4
+    uint32_t                            _kalman_p;      // Estimate variance in Q4
+    uint32_t                            _kalman_q;      // Process noise variance in Q4
+    uint32_t                            _kalman_r;      // Measurement noise variance in Q4
+    bool                                _kalman_init;
+    
+    /** Filter "input.distance" of each input report
+     *
+     *  @note Kalman filter runs in O(1) time. Median filter sorts a copy of its window, in
+     *        O(NUBRICK_SONAR_MEDIAN_SIZE^2) time at worst.
+     */
+    void on_input_report(NuBrickMaster &master, uint32_t pulled_mask, uint32_t changed_mask);
 };
 
 #endif
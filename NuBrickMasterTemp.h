@@ -40,8 +40,9 @@ public:
     /** Create an I2C interface, connected to the specified pins
      *
      *  @param i2c I2C object
+     *  @param i2c_addr 8-bit I2C slave address [ addr | 0 ], overridden e.g. for a second brick of the same type
      */
-    NuBrickMasterTemp(I2C &i2c, bool debug);
+    NuBrickMasterTemp(I2C &i2c, bool debug, int i2c_addr = NuBrick_I2CAddr_Temp);
 
     virtual ~NuBrickMasterTemp() {
         // Do nothing
@@ -0,0 +1,76 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickPacer.h"
+#include "hal/us_ticker_api.h"
+
+NuBrickPacer::NuBrickPacer() :
+    _last_tick_us(0), _elapsed_us(0) {
+    
+    // No lock needed in the constructor
+}
+
+void NuBrickPacer::start(void) {
+    
+    _start_tp = rtos::Kernel::Clock::now();
+    _last_tick_us = us_ticker_read();
+    _elapsed_us = 0;
+}
+
+void NuBrickPacer::wait_until(uint64_t offset_us, uint32_t flags) {
+    
+    rtos::ThisThread::flags_wait_any_until(flags, _start_tp + std::chrono::milliseconds(offset_us / 1000));
+}
+
+uint64_t NuBrickPacer::elapsed_us(void) {
+    
+    // Accumulate 32-bit ticker deltas, which stay right across one wrap
+    uint32_t tick_us = us_ticker_read();
+    _elapsed_us += (uint32_t) (tick_us - _last_tick_us);
+    _last_tick_us = tick_us;
+    
+    return _elapsed_us;
+}
+
+void NuBrickPaceStats::reset(void) {
+    
+    _num_samples = 0;
+    _jitter_sum = 0;
+    _jitter_max = 0;
+    _first_us = 0;
+    _last_us = 0;
+}
+
+void NuBrickPaceStats::add(uint64_t time_us, uint32_t jitter_us) {
+    
+    if (_num_samples == 0) {
+        _first_us = time_us;
+    }
+    _last_us = time_us;
+    _num_samples ++;
+    _jitter_sum += jitter_us;
+    if (jitter_us > _jitter_max) {
+        _jitter_max = jitter_us;
+    }
+}
+
+uint32_t NuBrickPaceStats::get_rate(void) const {
+    
+    if (_num_samples < 2 || _last_us == _first_us) {
+        return 0;
+    }
+    
+    return (uint32_t) ((uint64_t) (_num_samples - 1) * 1000000000ULL / (_last_us - _first_us));
+}
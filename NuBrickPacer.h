@@ -0,0 +1,122 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_PACER_H
+#define NUBRICK_PACER_H
+
+#include "mbed.h"
+
+/** A schedule clock of a paced thread loop, e.g. of streaming, capture or playback
+ *
+ * @note Synchronization level: Not protected, for use by the paced thread or under the owner's lock
+ *
+ * @details Time is kept in us since start() in 64 bits, extended from the 32-bit us ticker,
+ *          so it doesn't wrap after ~71 minutes. elapsed_us() must be called at least once
+ *          per wrap period of the us ticker, which any paced loop does.
+ */
+class NuBrickPacer {
+
+public:
+
+    NuBrickPacer();
+    
+    /** Start schedule from now
+     */
+    void start(void);
+    
+    /** Wait until offset_us after start, or until any of thread flags is set
+     *
+     *  @param offset_us schedule time in us since start()
+     *  @param flags thread flags to wake up on
+     */
+    void wait_until(uint64_t offset_us, uint32_t flags);
+    
+    /** Get time in us since start()
+     */
+    uint64_t elapsed_us(void);
+    
+    /** Get lateness in us of now against schedule time, negative if early
+     */
+    int64_t lateness_us(uint64_t offset_us) {
+        return (int64_t) elapsed_us() - (int64_t) offset_us;
+    }
+    
+    /** Get absolute value of lateness, saturated to 32 bits
+     */
+    static uint32_t abs_us(int64_t lateness_us) {
+        uint64_t abs_lateness_us = (lateness_us < 0) ? -lateness_us : lateness_us;
+        return (abs_lateness_us > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t) abs_lateness_us;
+    }
+    
+protected:
+    rtos::Kernel::Clock::time_point     _start_tp;
+    uint32_t                            _last_tick_us;
+    uint64_t                            _elapsed_us;
+};
+
+/** Timing statistics of samples taken by a paced thread loop
+ *
+ * @note Synchronization level: Not protected, guarded by the owner's lock
+ */
+class NuBrickPaceStats {
+
+public:
+
+    NuBrickPaceStats() {
+        reset();
+    }
+    
+    /** Clear statistics
+     */
+    void reset(void);
+    
+    /** Account one sample
+     *
+     *  @param time_us time of sample from NuBrickPacer::elapsed_us()
+     *  @param jitter_us absolute lateness of sample against schedule
+     */
+    void add(uint64_t time_us, uint32_t jitter_us);
+    
+    /** Get number of samples
+     */
+    uint32_t get_num_samples(void) const {
+        return _num_samples;
+    }
+    
+    /** Get achieved sample rate in mHz, between the first and the last sample
+     */
+    uint32_t get_rate(void) const;
+    
+    /** Get mean jitter in us
+     */
+    uint32_t get_jitter_mean(void) const {
+        return _num_samples ? (uint32_t) (_jitter_sum / _num_samples) : 0;
+    }
+    
+    /** Get maximum jitter in us
+     */
+    uint32_t get_jitter_max(void) const {
+        return _jitter_max;
+    }
+    
+protected:
+    uint32_t                            _num_samples;
+    uint64_t                            _jitter_sum;
+    uint32_t                            _jitter_max;
+    uint64_t                            _first_us;
+    uint64_t                            _last_us;
+};
+
+#endif
@@ -0,0 +1,509 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickPollScheduler.h"
+
+/* Thread flag to wake up polling thread */
+#define NUBRICK_POLL_FLAG_WAKEUP        0x1
+
+NuBrickPollScheduler::NuBrickPollScheduler() :
+    _num_entries(0), _num_ready_pulls(0), _num_poll_pulls(0),
+    _num_switches(0), _switch_rate(0), _switch_window_base(0), _switch_window_start(rtos::Kernel::Clock::now()),
+    _thread(NULL), _running(false) {
+    
+    // No lock needed in the constructor
+    
+    unsigned i;
+    for (i = 0; i < NUBRICK_MAX_DATA_READY_LINES; i ++) {
+        _lines[i].owner = this;
+        _lines[i].in = NULL;
+        _lines[i].simulated = false;
+        _lines[i].num_users = 0;
+    }
+}
+
+NuBrickPollScheduler::~NuBrickPollScheduler() {
+    
+    stop();
+    
+    unsigned i;
+    for (i = 0; i < NUBRICK_MAX_DATA_READY_LINES; i ++) {
+        delete _lines[i].in;
+        _lines[i].in = NULL;
+    }
+}
+
+bool NuBrickPollScheduler::add(NuBrickMaster &master) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    if (_num_entries >= NUBRICK_MAX_POLL_BRICKS) {
+        _mutex.unlock();
+        return false;
+    }
+    
+    unsigned i;
+    for (i = 0; i < _num_entries; i ++) {
+        if (_entries[i].master == &master) {
+            _mutex.unlock();
+            return true;
+        }
+    }
+    
+    // Due immediately
+    _entries[_num_entries].master = &master;
+    _entries[_num_entries].due = rtos::Kernel::Clock::now();
+    _entries[_num_entries].backoff = 0;
+    _entries[_num_entries].line = -1;
+    _entries[_num_entries].ready = 0;
+    _num_entries ++;
+    rebase_switches();
+    
+    _mutex.unlock();
+    
+    if (_thread) {
+        _thread->flags_set(NUBRICK_POLL_FLAG_WAKEUP);
+    }
+    
+    return true;
+}
+
+bool NuBrickPollScheduler::remove(NuBrickMaster &master) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    unsigned i;
+    for (i = 0; i < _num_entries; i ++) {
+        if (_entries[i].master == &master) {
+            release_line(_entries[i].line);
+            _entries[i] = _entries[_num_entries - 1];
+            _num_entries --;
+            rebase_switches();
+            _mutex.unlock();
+            return true;
+        }
+    }
+    
+    _mutex.unlock();
+    return false;
+}
+
+bool NuBrickPollScheduler::attach_data_ready(NuBrickMaster &master, PinName pin, bool active_low) {
+    
+    return attach_line(master, pin, active_low, false);
+}
+
+bool NuBrickPollScheduler::attach_simulated_line(NuBrickMaster &master, PinName pin) {
+    
+    return attach_line(master, pin, false, true);
+}
+
+bool NuBrickPollScheduler::attach_line(NuBrickMaster &master, PinName pin, bool active_low, bool simulated) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    Entry *entry = NULL;
+    unsigned i;
+    for (i = 0; i < _num_entries; i ++) {
+        if (_entries[i].master == &master) {
+            entry = _entries + i;
+            break;
+        }
+    }
+    if (entry == NULL || entry->line >= 0) {
+        _mutex.unlock();
+        return false;
+    }
+    
+    // Share line on the same pin, or take a free one
+    int line = -1;
+    for (i = 0; i < NUBRICK_MAX_DATA_READY_LINES; i ++) {
+        if (_lines[i].num_users && _lines[i].pin == pin) {
+            line = i;
+            break;
+        }
+        if (line < 0 && _lines[i].num_users == 0) {
+            line = i;
+        }
+    }
+    if (line < 0 || (_lines[line].num_users && (_lines[line].active_low != active_low || _lines[line].simulated != simulated))) {
+        _mutex.unlock();
+        return false;
+    }
+    
+    DataReadyLine *drl = _lines + line;
+    if (drl->num_users == 0) {
+        drl->pin = pin;
+        drl->active_low = active_low;
+        drl->simulated = simulated;
+        drl->sim_level = 0;
+        drl->edge = 0;
+        drl->retriggers = 0;
+        drl->stuck = false;
+    }
+    if (drl->num_users == 0 && ! simulated) {
+        drl->in = new mbed::InterruptIn(pin);
+        if (active_low) {
+            drl->in->fall(mbed::callback(drl, &DataReadyLine::isr));
+        }
+        else {
+            drl->in->rise(mbed::callback(drl, &DataReadyLine::isr));
+        }
+    }
+    drl->num_users ++;
+    entry->line = line;
+    
+    _mutex.unlock();
+    
+    return true;
+}
+
+bool NuBrickPollScheduler::detach_data_ready(NuBrickMaster &master) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    unsigned i;
+    for (i = 0; i < _num_entries; i ++) {
+        if (_entries[i].master == &master && _entries[i].line >= 0) {
+            release_line(_entries[i].line);
+            _entries[i].line = -1;
+            _entries[i].due = rtos::Kernel::Clock::now();
+            _mutex.unlock();
+            return true;
+        }
+    }
+    
+    _mutex.unlock();
+    return false;
+}
+
+void NuBrickPollScheduler::notify_data_ready(NuBrickMaster &master) {
+    
+    // No lock in ISR: a stale match just costs one extra pull
+    unsigned i;
+    for (i = 0; i < _num_entries; i ++) {
+        if (_entries[i].master == &master) {
+            core_util_atomic_store_u8(&_entries[i].ready, 1);
+            break;
+        }
+    }
+    
+    wakeup();
+}
+
+void NuBrickPollScheduler::drive_line(PinName pin, bool asserted) {
+    
+    // No lock in ISR, as notify_data_ready()
+    unsigned i;
+    for (i = 0; i < NUBRICK_MAX_DATA_READY_LINES; i ++) {
+        DataReadyLine *drl = _lines + i;
+        if (drl->simulated && drl->num_users && drl->pin == pin) {
+            bool prev = core_util_atomic_exchange_u8(&drl->sim_level, asserted ? 1 : 0);
+            if (asserted && ! prev) {
+                notify_line(i);
+            }
+            break;
+        }
+    }
+}
+
+void NuBrickPollScheduler::notify_line(unsigned line) {
+    
+    // An edge proves the line is not stuck
+    core_util_atomic_store_u8(&_lines[line].edge, 1);
+    
+    unsigned i;
+    for (i = 0; i < _num_entries; i ++) {
+        if (_entries[i].line == (int) line) {
+            core_util_atomic_store_u8(&_entries[i].ready, 1);
+        }
+    }
+    
+    wakeup();
+}
+
+void NuBrickPollScheduler::wakeup(void) {
+    
+    rtos::Thread *thread = _thread;
+    if (thread) {
+        thread->flags_set(NUBRICK_POLL_FLAG_WAKEUP);
+    }
+}
+
+void NuBrickPollScheduler::release_line(int line) {
+    
+    if (line < 0) {
+        return;
+    }
+    
+    DataReadyLine *drl = _lines + line;
+    if (-- drl->num_users == 0) {
+        delete drl->in;
+        drl->in = NULL;
+    }
+}
+
+bool NuBrickPollScheduler::line_asserted(unsigned line) {
+    
+    DataReadyLine *drl = _lines + line;
+    if (drl->simulated) {
+        return drl->sim_level != 0;
+    }
+    
+    return drl->in && drl->in->read() == (drl->active_low ? 0 : 1);
+}
+
+void NuBrickPollScheduler::check_lines(uint32_t line_mask, uint32_t pulled_mask, rtos::Kernel::Clock::time_point now) {
+    
+    unsigned line;
+    for (line = 0; line < NUBRICK_MAX_DATA_READY_LINES; line ++) {
+        DataReadyLine *drl = _lines + line;
+        if (drl->num_users == 0) {
+            continue;
+        }
+        
+        // Deasserted or fresh edge: not stuck
+        bool edge = core_util_atomic_exchange_u8(&drl->edge, 0);
+        bool asserted = line_asserted(line);
+        if (edge || ! asserted) {
+            drl->retriggers = 0;
+            drl->stuck = false;
+        }
+        if (drl->stuck || ! asserted || ! (line_mask & (1UL << line))) {
+            continue;
+        }
+        
+        // Still asserted with no edge for too long: stuck, fall back to polling
+        if (++ drl->retriggers > NUBRICK_DATA_READY_MAX_RETRIGGERS) {
+            drl->stuck = true;
+            continue;
+        }
+        
+        // Another module on the wired-OR line has data ready. Pull the rest at once, and the ones
+        // just pulled again no sooner than the retrigger interval, so a stuck line can't busy-loop.
+        bool marked = false;
+        unsigned i;
+        for (i = 0; i < _num_entries; i ++) {
+            Entry *entry = _entries + i;
+            if (entry->line != (int) line) {
+                continue;
+            }
+            if (pulled_mask & (1UL << i)) {
+                entry->due = now + std::chrono::milliseconds(NUBRICK_DATA_READY_RETRIGGER);
+            }
+            else {
+                core_util_atomic_store_u8(&entry->ready, 1);
+                marked = true;
+            }
+        }
+        if (marked) {
+            wakeup();
+        }
+    }
+}
+
+uint32_t NuBrickPollScheduler::poll(void) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    rtos::Kernel::Clock::time_point now = rtos::Kernel::Clock::now();
+    rtos::Kernel::Clock::time_point next_due = now + std::chrono::milliseconds(NUBRICK_POLL_INTERVAL_DEFAULT);
+    
+    // Visit modules grouped by mux channel to switch channel as rarely as possible
+    unsigned order[NUBRICK_MAX_POLL_BRICKS];
+    order_by_channel(order);
+    
+    uint32_t line_mask = 0;
+    uint32_t pulled_mask = 0;
+    unsigned i;
+    for (i = 0; i < _num_entries; i ++) {
+        Entry *entry = _entries + order[i];
+        bool ready = core_util_atomic_exchange_u8(&entry->ready, 0);
+        
+        if ((ready || entry->due <= now) && entry->master->get_health() == NuBrick_Health_Degraded) {
+            // Out of rotation: re-probe at exponential backoff
+            if (entry->master->probe()) {
+                entry->backoff = 0;
+                entry->due = rtos::Kernel::Clock::now();
+            }
+            else {
+                entry->backoff = entry->backoff ? (entry->backoff * 2) : NUBRICK_PROBE_BACKOFF_MIN;
+                if (entry->backoff > NUBRICK_PROBE_BACKOFF_MAX) {
+                    entry->backoff = NUBRICK_PROBE_BACKOFF_MAX;
+                }
+                entry->due = rtos::Kernel::Clock::now() + std::chrono::milliseconds(entry->backoff);
+            }
+            now = rtos::Kernel::Clock::now();
+        }
+        else if (line_driven(*entry)) {
+            if (ready || entry->due <= now) {
+                // Data ready, or fallback poll as a safety net
+                entry->master->pull_input_report();
+                if (ready) {
+                    _num_ready_pulls = _num_ready_pulls + 1;
+                }
+                else {
+                    _num_poll_pulls = _num_poll_pulls + 1;
+                }
+                now = rtos::Kernel::Clock::now();
+                entry->due = now + std::chrono::milliseconds(NUBRICK_DATA_READY_FALLBACK);
+                
+                // Line level is checked once all modules of this pass are pulled
+                line_mask |= (1UL << entry->line);
+                pulled_mask |= (1UL << order[i]);
+            }
+        }
+        else if (entry->due <= now) {
+            entry->master->pull_input_report_adaptive();
+            _num_poll_pulls = _num_poll_pulls + 1;
+            
+            // Re-schedule from due time rather than now to keep rate, but never catch up with a burst
+            entry->due += std::chrono::milliseconds(entry->master->get_poll_interval());
+            now = rtos::Kernel::Clock::now();
+            if (entry->due < now) {
+                entry->due = now;
+            }
+        }
+    }
+    
+    // Wired-OR lines still asserted after their pulls, then the earliest due
+    check_lines(line_mask, pulled_mask, now);
+    for (i = 0; i < _num_entries; i ++) {
+        if (_entries[i].due < next_due) {
+            next_due = _entries[i].due;
+        }
+    }
+    
+    // Channel switches per second, over window of at least 1 s
+    _num_switches = count_switches();
+    uint32_t window = (now - _switch_window_start).count();
+    if (window >= 1000) {
+        _switch_rate = (uint32_t) ((uint64_t) (_num_switches - _switch_window_base) * 1000 / window);
+        _switch_window_base = _num_switches;
+        _switch_window_start = now;
+    }
+    
+    _mutex.unlock();
+    
+    return (next_due > now) ? (uint32_t) (next_due - now).count() : 0;
+}
+
+bool NuBrickPollScheduler::start(osPriority priority) {
+    
+    if (_thread) {
+        return true;
+    }
+    
+    _running = true;
+    _thread = new rtos::Thread(priority);
+    if (_thread->start(mbed::callback(this, &NuBrickPollScheduler::thread_main)) != osOK) {
+        delete _thread;
+        _thread = NULL;
+        _running = false;
+        return false;
+    }
+    
+    return true;
+}
+
+void NuBrickPollScheduler::stop(void) {
+    
+    if (! _thread) {
+        return;
+    }
+    
+    _running = false;
+    _thread->flags_set(NUBRICK_POLL_FLAG_WAKEUP);
+    _thread->join();
+    delete _thread;
+    _thread = NULL;
+}
+
+void NuBrickPollScheduler::order_by_channel(unsigned *order) {
+    
+    // Stable insertion sort, as there are only a few entries
+    unsigned i, j;
+    for (i = 0; i < _num_entries; i ++) {
+        for (j = i; j > 0 && channel_before(_entries[i], _entries[order[j - 1]]); j --) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+}
+
+uint32_t NuBrickPollScheduler::count_switches(void) {
+    
+    uint32_t num_switches = 0;
+    unsigned i, j;
+    for (i = 0; i < _num_entries; i ++) {
+        NuBrickI2CMux *mux = _entries[i].master->get_mux();
+        if (mux == NULL) {
+            continue;
+        }
+        
+        // Count each mux once
+        bool counted = false;
+        for (j = 0; j < i; j ++) {
+            if (_entries[j].master->get_mux() == mux) {
+                counted = true;
+                break;
+            }
+        }
+        if (! counted) {
+            num_switches += mux->get_num_switches();
+        }
+    }
+    
+    return num_switches;
+}
+
+void NuBrickPollScheduler::rebase_switches(void) {
+    
+    // Set of muxes changed, restart rate window on the new sum
+    _num_switches = count_switches();
+    _switch_window_base = _num_switches;
+    _switch_window_start = rtos::Kernel::Clock::now();
+}
+
+bool NuBrickPollScheduler::channel_before(const Entry &a, const Entry &b) {
+    
+    NuBrickI2CMux *mux_a = a.master->get_mux();
+    NuBrickI2CMux *mux_b = b.master->get_mux();
+    int channel_a = a.master->get_mux_channel();
+    int channel_b = b.master->get_mux_channel();
+    
+    // Not behind mux first, then channel already selected, then the rest
+    unsigned rank_a = (mux_a == NULL) ? 0 : ((mux_a->get_channel() == channel_a) ? 1 : 2);
+    unsigned rank_b = (mux_b == NULL) ? 0 : ((mux_b->get_channel() == channel_b) ? 1 : 2);
+    if (rank_a != rank_b) {
+        return rank_a < rank_b;
+    }
+    
+    if (mux_a != mux_b) {
+        return (uintptr_t) mux_a < (uintptr_t) mux_b;
+    }
+    
+    return channel_a < channel_b;
+}
+
+void NuBrickPollScheduler::thread_main(void) {
+    
+    while (_running) {
+        uint32_t wait_ms = poll();
+        if (wait_ms) {
+            rtos::ThisThread::flags_wait_any_for(NUBRICK_POLL_FLAG_WAKEUP, std::chrono::milliseconds(wait_ms));
+        }
+    }
+}
@@ -0,0 +1,306 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_POLL_SCHEDULER_H
+#define NUBRICK_POLL_SCHEDULER_H
+
+#include "mbed.h"
+#include "NuBrickMaster.h"
+
+/** Maximum number of NuMaker Brick I2C slave modules polled by one NuBrickPollScheduler object
+ */
+#ifndef NUBRICK_MAX_POLL_BRICKS
+#define NUBRICK_MAX_POLL_BRICKS         8
+#endif
+
+/** Initial/maximum interval of re-probing degraded module in ms, doubled on each failed probe
+ */
+#ifndef NUBRICK_PROBE_BACKOFF_MIN
+#define NUBRICK_PROBE_BACKOFF_MIN       100
+#endif
+#ifndef NUBRICK_PROBE_BACKOFF_MAX
+#define NUBRICK_PROBE_BACKOFF_MAX       5000
+#endif
+
+/** Maximum number of data-ready lines of one NuBrickPollScheduler object
+ */
+#ifndef NUBRICK_MAX_DATA_READY_LINES
+#define NUBRICK_MAX_DATA_READY_LINES    4
+#endif
+
+/** Fallback poll interval in ms of module with data-ready line, as a safety net for lost edges
+ */
+#ifndef NUBRICK_DATA_READY_FALLBACK
+#define NUBRICK_DATA_READY_FALLBACK     1000
+#endif
+
+/** Minimum interval in ms of re-pulling a module whose wired-OR line stays asserted after its pull
+ */
+#ifndef NUBRICK_DATA_READY_RETRIGGER
+#define NUBRICK_DATA_READY_RETRIGGER    5
+#endif
+
+/** Number of consecutive retriggers before a line stuck asserted falls back to polling
+ */
+#ifndef NUBRICK_DATA_READY_MAX_RETRIGGERS
+#define NUBRICK_DATA_READY_MAX_RETRIGGERS   16
+#endif
+
+/** A scheduler polling input report of NuMaker Brick I2C slave modules at their adaptive rates
+ *
+ * @note Synchronization level: Thread safe
+ *
+ * @details Each added module is pulled through NuBrickMaster::pull_input_report_adaptive()
+ *          and becomes due again after its NuBrickMaster::get_poll_interval(). Bus time
+ *          thus goes to modules with signal activity.
+ *
+ *          Modules degraded for consecutive failures (see NuBrickMaster::get_health()) are pulled
+ *          out of the rotation and re-probed with NuBrickMaster::probe() at exponential backoff,
+ *          so a dead module costs one transfer per backoff period rather than one per poll.
+ *
+ *          A module can have a data-ready line instead, attached with attach_data_ready(). Its
+ *          input report is then pulled from the polling thread once the line gets asserted, and
+ *          otherwise only every NUBRICK_DATA_READY_FALLBACK ms. Several modules can share one
+ *          wired-OR line: all of them get pulled. While the line stays asserted, modules not pulled in
+ *          that pass get pulled at once, and the ones just pulled again after NUBRICK_DATA_READY_RETRIGGER
+ *          ms. After NUBRICK_DATA_READY_MAX_RETRIGGERS such passes in a row, the line is taken as
+ *          stuck and its modules fall back to adaptive polling until it deasserts or has an edge.
+ *          notify_data_ready() is the same path without a pin, e.g. for a simulator on host.
+ *          attach_simulated_line() and drive_line() drive the shared line path without a pin.
+ *
+ *          Modules behind I2C mux (see NuBrickMaster::attach_mux()) are visited grouped by mux
+ *          channel, starting with the channel already selected, so each channel gets switched
+ *          to at most once per poll.
+ */
+class NuBrickPollScheduler {
+
+public:
+
+    NuBrickPollScheduler();
+
+    virtual ~NuBrickPollScheduler();
+    
+    /** Add NuMaker Brick I2C slave module to poll rotation
+     *
+     *  @param master connected NuBrickMaster object
+     *  @return true if success, false if failure
+     */
+    bool add(NuBrickMaster &master);
+    
+    /** Remove NuMaker Brick I2C slave module from poll rotation
+     *
+     *  @return true if success, false if failure
+     */
+    bool remove(NuBrickMaster &master);
+    
+    /** Attach data-ready line of NuMaker Brick I2C slave module
+     *
+     *  @param master NuBrickMaster object added already
+     *  @param pin data-ready pin. Modules on the same pin share a wired-OR line.
+     *  @param active_low true if asserted low, false if asserted high
+     *  @return true if success, false if failure
+     */
+    bool attach_data_ready(NuBrickMaster &master, PinName pin, bool active_low = true);
+    
+    /** Attach simulated data-ready line of NuMaker Brick I2C slave module, driven by drive_line() instead of a pin
+     *
+     *  @param master NuBrickMaster object added already
+     *  @param pin identifier of the line only. Modules on the same pin share a wired-OR line.
+     *  @return true if success, false if failure
+     *
+     *  @note For a simulator on host, with no InterruptIn involved
+     */
+    bool attach_simulated_line(NuBrickMaster &master, PinName pin);
+    
+    /** Drive level of simulated data-ready line attached with attach_simulated_line()
+     *
+     *  @param pin identifier of the line
+     *  @param asserted true to assert, false to deassert. Asserting is an edge, as the ISR of a real line.
+     *
+     *  @note ISR-safe
+     */
+    void drive_line(PinName pin, bool asserted);
+    
+    /** Detach data-ready line of NuMaker Brick I2C slave module, back to adaptive polling
+     *
+     *  @return true if success, false if failure
+     */
+    bool detach_data_ready(NuBrickMaster &master);
+    
+    /** Signal data ready of NuMaker Brick I2C slave module
+     *
+     *  @note ISR-safe. Without a pin attached, a simulator can drive the module this way.
+     */
+    void notify_data_ready(NuBrickMaster &master);
+    
+    /** Get number of pulls triggered by data ready
+     */
+    uint32_t get_num_ready_pulls(void) {
+        return _num_ready_pulls;
+    }
+    
+    /** Get number of pulls by poll, including fallback poll of modules with data-ready line
+     */
+    uint32_t get_num_poll_pulls(void) {
+        return _num_poll_pulls;
+    }
+    
+    /** Get number of I2C mux channel switches on the muxes of polled modules, as of the last poll
+     *
+     *  @note Counted by the muxes themselves, so switches by other threads on the bus are included
+     */
+    uint32_t get_num_channel_switches(void) {
+        return _num_switches;
+    }
+    
+    /** Get I2C mux channel switches per second on the muxes of polled modules, measured over the last second
+     */
+    uint32_t get_channel_switch_rate(void) {
+        return _switch_rate;
+    }
+    
+    /** Pull input report of all due modules
+     *
+     *  @return time to wait in ms until next module is due
+     */
+    uint32_t poll(void);
+    
+    /** Start polling in dedicated thread
+     *
+     *  @param priority priority of the polling thread
+     *  @return true if success, false if failure
+     */
+    bool start(osPriority priority = osPriorityNormal);
+    
+    /** Stop polling thread started by start()
+     */
+    void stop(void);
+    
+protected:
+    /** Poll entry of one module
+     */
+    struct Entry {
+        NuBrickMaster *                 master;
+        rtos::Kernel::Clock::time_point due;
+        uint32_t                        backoff;    // Re-probe interval in ms, 0 if healthy
+        int                             line;       // Index of data-ready line, -1 if none
+        volatile uint8_t                ready;      // Data ready signaled, set from ISR
+    };
+    
+    /** Data-ready line, shared by modules on the same pin
+     */
+    struct DataReadyLine {
+        NuBrickPollScheduler *          owner;
+        mbed::InterruptIn *             in;
+        PinName                         pin;
+        bool                            active_low;
+        bool                            simulated;  // Driven by drive_line(), with no InterruptIn
+        volatile uint8_t                sim_level;  // Asserted level of simulated line
+        volatile uint8_t                edge;       // Edge seen since last check, set from ISR
+        unsigned                        num_users;
+        unsigned                        retriggers; // Consecutive passes ending with the line still asserted
+        bool                            stuck;      // Stuck asserted, modules polled instead
+        
+        /** ISR of the line
+         */
+        void isr(void) {
+            owner->notify_line(this - owner->_lines);
+        }
+    };
+    
+    Entry                               _entries[NUBRICK_MAX_POLL_BRICKS];
+    unsigned                            _num_entries;
+    DataReadyLine                       _lines[NUBRICK_MAX_DATA_READY_LINES];
+    volatile uint32_t                   _num_ready_pulls;
+    volatile uint32_t                   _num_poll_pulls;
+    volatile uint32_t                   _num_switches;
+    volatile uint32_t                   _switch_rate;
+    uint32_t                            _switch_window_base;
+    rtos::Kernel::Clock::time_point     _switch_window_start;
+    rtos::Mutex                         _mutex;
+    rtos::Thread *                      _thread;
+    volatile bool                       _running;
+    
+    /** Mark all modules on data-ready line ready and wake up polling thread, on edge of the line
+     *
+     *  @note ISR-safe
+     */
+    void notify_line(unsigned line);
+    
+    /** Attach data-ready line, with InterruptIn on pin unless simulated
+     */
+    bool attach_line(NuBrickMaster &master, PinName pin, bool active_low, bool simulated);
+    
+    /** Check if data-ready line reads asserted
+     */
+    bool line_asserted(unsigned line);
+    
+    /** Check if module is pulled on its data-ready line, rather than polled
+     */
+    bool line_driven(const Entry &entry) {
+        return entry.line >= 0 && ! _lines[entry.line].stuck;
+    }
+    
+    /** Re-pull modules on data-ready lines still asserted after their pulls in this pass
+     *
+     *  @param line_mask lines with pulls in this pass
+     *  @param pulled_mask entries pulled in this pass
+     *
+     *  @note Called with _mutex held
+     */
+    void check_lines(uint32_t line_mask, uint32_t pulled_mask, rtos::Kernel::Clock::time_point now);
+    
+    /** Wake up polling thread
+     *
+     *  @note ISR-safe
+     */
+    void wakeup(void);
+    
+    /** Release one user of data-ready line, deleting InterruptIn with no user left
+     *
+     *  @note Called with _mutex held
+     */
+    void release_line(int line);
+    
+    /** Order entries grouped by I2C mux channel, current channel of each mux first
+     *
+     *  @param order array to receive indexes of entries
+     *
+     *  @note Called with _mutex held
+     */
+    void order_by_channel(unsigned *order);
+    
+    /** Sum channel switch counters of distinct muxes of polled modules
+     *
+     *  @note Called with _mutex held
+     */
+    uint32_t count_switches(void);
+    
+    /** Restart channel switch rate window after modules are added or removed
+     *
+     *  @note Called with _mutex held
+     */
+    void rebase_switches(void);
+    
+    /** Check if entry a goes before entry b in order_by_channel()
+     */
+    static bool channel_before(const Entry &a, const Entry &b);
+    
+    /** Thread entry of start()
+     */
+    void thread_main(void);
+};
+
+#endif
@@ -0,0 +1,98 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickRecorder.h"
+#include "hal/us_ticker_api.h"
+
+NuBrickRecorder::NuBrickRecorder(uint8_t *buf, size_t size) :
+    _buf(buf), _buf_pos(buf), _buf_end(buf + size), _overflowed(false), _started(false), _last_us(0) {
+    
+    // No lock needed in the constructor
+    
+    reset();
+}
+
+void NuBrickRecorder::record(uint8_t flags, int address, const uint8_t *data, int length) {
+    
+    uint32_t now_us = us_ticker_read();
+    
+    // Support thread-safe
+    _mutex.lock();
+    
+    if (_overflowed) {
+        _mutex.unlock();
+        return;
+    }
+    
+    uint32_t delta_us = _started ? (now_us - _last_us) : 0;
+    _started = true;
+    _last_us = now_us;
+    
+    // Worst case: 3-byte header, 5-byte time, and data
+    if ((_buf_end - _buf_pos) < (8 + length) || length > 0xFF) {
+        _overflowed = true;
+        _mutex.unlock();
+        return;
+    }
+    
+    *_buf_pos ++ = flags;
+    *_buf_pos ++ = (uint8_t) address;
+    *_buf_pos ++ = (uint8_t) length;
+    do {
+        uint8_t byte = delta_us & 0x7F;
+        delta_us >>= 7;
+        *_buf_pos ++ = delta_us ? (byte | 0x80) : byte;
+    } while (delta_us);
+    memcpy(_buf_pos, data, length);
+    _buf_pos += length;
+    
+    _mutex.unlock();
+}
+
+size_t NuBrickRecorder::size(void) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    size_t size = _buf_pos - _buf;
+    
+    _mutex.unlock();
+    
+    return size;
+}
+
+bool NuBrickRecorder::overflowed(void) {
+    
+    return _overflowed;
+}
+
+void NuBrickRecorder::reset(void) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    _buf_pos = _buf;
+    _overflowed = false;
+    _started = false;
+    
+    // Magic
+    if ((_buf_end - _buf_pos) >= 4) {
+        memcpy(_buf_pos, NUBRICK_RECORD_MAGIC, 4);
+        _buf_pos += 4;
+    }
+    else {
+        _overflowed = true;
+    }
+    
+    _mutex.unlock();
+}
@@ -0,0 +1,100 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_RECORDER_H
+#define NUBRICK_RECORDER_H
+
+#include "mbed.h"
+
+/** Binary session recording: magic
+ */
+#define NUBRICK_RECORD_MAGIC            "NBR1"
+
+/** Binary session recording: record flags
+ */
+enum NuBrick_RecordFlag {
+    NuBrick_RecordFlag_Read         = 0x01,     // I2C read, otherwise I2C write
+    NuBrick_RecordFlag_Repeated     = 0x02,     // Repeated start, no stop at end
+    NuBrick_RecordFlag_Failed       = 0x04,     // Transfer failed (nack)
+};
+
+/** A compact binary recorder of raw bus transactions of NuBrickMaster objects
+ *
+ * @note Synchronization level: Thread safe
+ *
+ * @details Recording starts with 4-byte magic NUBRICK_RECORD_MAGIC, followed by one record per
+ *          I2C write/read:
+ *          - 1 byte: flags, combination of NuBrick_RecordFlag
+ *          - 1 byte: 8-bit I2C slave address
+ *          - 1 byte: length of data
+ *          - 1~5 bytes: time in us since previous record, unsigned LEB128
+ *          - N bytes: data written, or data read. For write, the first 2 bytes are command code
+ *            in little-endian.
+ *
+ *          Recording stops when the buffer gets full.
+ */
+class NuBrickRecorder {
+
+public:
+
+    /** Create a recorder
+     *
+     *  @param buf buffer to record into
+     *  @param size size of buf
+     */
+    NuBrickRecorder(uint8_t *buf, size_t size);
+
+    virtual ~NuBrickRecorder() {
+        // Do nothing
+    }
+    
+    /** Record one I2C write/read
+     *
+     *  @param flags combination of NuBrick_RecordFlag
+     *  @param address 8-bit I2C slave address
+     *  @param data data written/read
+     *  @param length length of data
+     */
+    void record(uint8_t flags, int address, const uint8_t *data, int length);
+    
+    /** Get recording
+     */
+    const uint8_t *data(void) {
+        return _buf;
+    }
+    
+    /** Get size of recording
+     */
+    size_t size(void);
+    
+    /** Has recording stopped for buffer full?
+     */
+    bool overflowed(void);
+    
+    /** Discard recording and start over
+     */
+    void reset(void);
+    
+protected:
+    uint8_t *                           _buf;
+    uint8_t *                           _buf_pos;
+    uint8_t * const                     _buf_end;
+    bool                                _overflowed;
+    bool                                _started;
+    uint32_t                            _last_us;
+    rtos::Mutex                         _mutex;
+};
+
+#endif
@@ -0,0 +1,159 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickReplayTransport.h"
+
+NuBrickReplayTransport::NuBrickReplayTransport(const uint8_t *rec, size_t size, unsigned speedup) :
+    _rec(rec), _rec_pos(rec), _rec_end(rec + size), _speedup(speedup), _mismatches(0),
+    _started(false), _rec_time_us(0) {
+    
+    // No lock needed in the constructor
+    
+    rewind();
+}
+
+int NuBrickReplayTransport::write(int address, const char *data, int length, bool repeated) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    uint8_t rec_flags;
+    uint8_t rec_address;
+    uint8_t rec_length;
+    const uint8_t *rec_data = next_record(rec_flags, rec_address, rec_length);
+    
+    if (rec_data == NULL || (rec_flags & NuBrick_RecordFlag_Read) || rec_address != (uint8_t) address) {
+        _mismatches ++;
+        _mutex.unlock();
+        return -1;
+    }
+    
+    // Data and stop condition must both match
+    if (rec_length != length || memcmp(rec_data, data, length) != 0 ||
+        ((rec_flags & NuBrick_RecordFlag_Repeated) != 0) != repeated) {
+        _mismatches ++;
+    }
+    
+    int rc = (rec_flags & NuBrick_RecordFlag_Failed) ? -1 : 0;
+    
+    _mutex.unlock();
+    
+    return rc;
+}
+
+int NuBrickReplayTransport::read(int address, char *data, int length, bool repeated) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    uint8_t rec_flags;
+    uint8_t rec_address;
+    uint8_t rec_length;
+    const uint8_t *rec_data = next_record(rec_flags, rec_address, rec_length);
+    
+    if (rec_data == NULL || ! (rec_flags & NuBrick_RecordFlag_Read) || rec_address != (uint8_t) address) {
+        _mismatches ++;
+        _mutex.unlock();
+        return -1;
+    }
+    
+    if (rec_length != length || ((rec_flags & NuBrick_RecordFlag_Repeated) != 0) != repeated) {
+        _mismatches ++;
+    }
+    
+    memcpy(data, rec_data, (rec_length < length) ? rec_length : length);
+    int rc = (rec_flags & NuBrick_RecordFlag_Failed) ? -1 : 0;
+    
+    _mutex.unlock();
+    
+    return rc;
+}
+
+void NuBrickReplayTransport::rewind(void) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    _rec_pos = _rec;
+    _started = false;
+    _rec_time_us = 0;
+    
+    // Skip magic
+    if ((_rec_end - _rec_pos) >= 4 && memcmp(_rec_pos, NUBRICK_RECORD_MAGIC, 4) == 0) {
+        _rec_pos += 4;
+    }
+    else {
+        _rec_pos = _rec_end;
+    }
+    
+    _mutex.unlock();
+}
+
+bool NuBrickReplayTransport::done(void) {
+    
+    return _rec_pos == _rec_end;
+}
+
+const uint8_t *NuBrickReplayTransport::next_record(uint8_t &flags, uint8_t &address, uint8_t &length) {
+    
+    if ((_rec_end - _rec_pos) < 4) {
+        _rec_pos = _rec_end;
+        return NULL;
+    }
+    
+    flags = *_rec_pos ++;
+    address = *_rec_pos ++;
+    length = *_rec_pos ++;
+    
+    // Time since previous record, unsigned LEB128
+    uint32_t delta_us = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+        if (_rec_pos == _rec_end || shift > 28) {
+            _rec_pos = _rec_end;
+            return NULL;
+        }
+        byte = *_rec_pos ++;
+        delta_us |= (uint32_t) (byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    
+    if ((_rec_end - _rec_pos) < length) {
+        _rec_pos = _rec_end;
+        return NULL;
+    }
+    const uint8_t *data = _rec_pos;
+    _rec_pos += length;
+    
+    // Replay at original/accelerated speed, relative to the first record
+    if (! _started) {
+        _started = true;
+        _clock.start();
+    }
+    else if (_speedup) {
+        // 64-bit replay time, so recordings longer than the 32-bit us ticker wrap keep timing
+        _rec_time_us += delta_us;
+        uint64_t target_us = _rec_time_us / _speedup;
+        uint64_t elapsed_us = _clock.elapsed_us();
+        if (target_us > elapsed_us) {
+            uint64_t wait = target_us - elapsed_us;
+            if (wait >= 1000) {
+                rtos::ThisThread::sleep_for(std::chrono::milliseconds(wait / 1000));
+                wait %= 1000;
+            }
+            wait_us((int) wait);
+        }
+    }
+    
+    return data;
+}
@@ -0,0 +1,84 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_REPLAY_TRANSPORT_H
+#define NUBRICK_REPLAY_TRANSPORT_H
+
+#include "mbed.h"
+#include "NuBrickTransport.h"
+#include "NuBrickRecorder.h"
+#include "NuBrickPacer.h"
+
+/** A simulated bus feeding a recording of NuBrickRecorder back into NuBrickMaster objects
+ *
+ * @note Synchronization level: Thread safe
+ *
+ * @details Records are consumed in order. Writes are checked against recorded writes and
+ *          reads return recorded data. Recorded failures are replayed as failures.
+ *          Transfers past the end of the recording or of the wrong direction/address fail.
+ */
+class NuBrickReplayTransport : public NuBrickTransport {
+
+public:
+
+    /** Create a replay transport
+     *
+     *  @param rec recording of NuBrickRecorder
+     *  @param size size of rec
+     *  @param speedup 1 for original speed, N for N times faster, 0 for no delay at all (e.g. for benchmark)
+     */
+    NuBrickReplayTransport(const uint8_t *rec, size_t size, unsigned speedup = 1);
+
+    virtual ~NuBrickReplayTransport() {
+        // Do nothing
+    }
+    
+    virtual int write(int address, const char *data, int length, bool repeated = false);
+    
+    virtual int read(int address, char *data, int length, bool repeated = false);
+    
+    /** Restart replay from the beginning
+     */
+    void rewind(void);
+    
+    /** Has replay reached the end of recording?
+     */
+    bool done(void);
+    
+    /** Get number of transfers not matching the recording in address, data, length or repeated start
+     */
+    unsigned mismatches(void) {
+        return _mismatches;
+    }
+    
+protected:
+    const uint8_t *                     _rec;
+    const uint8_t *                     _rec_pos;
+    const uint8_t * const               _rec_end;
+    unsigned                            _speedup;
+    unsigned                            _mismatches;
+    bool                                _started;
+    NuBrickPacer                        _clock;         // Replay time since the first record, guarded by _mutex
+    uint64_t                            _rec_time_us;
+    rtos::Mutex                         _mutex;
+    
+    /** Fetch next record and wait until its time
+     *
+     *  @return pointer to data of the record if success, NULL if end of recording or malformed
+     */
+    const uint8_t *next_record(uint8_t &flags, uint8_t &address, uint8_t &length);
+};
+
+#endif
@@ -0,0 +1,242 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickSerializer.h"
+#include <cstring>
+
+/* Device descriptor members by name, serialized member-wise rather than by layout */
+static const struct {
+    const char *                            name;
+    uint16_t NuBrick_Device_Descriptor::*   member;
+} dev_desc_members[] = {
+    {"dev_desc_len",         &NuBrick_Device_Descriptor::dev_desc_len},
+    {"report_desc_len",      &NuBrick_Device_Descriptor::report_desc_len},
+    {"input_report_len",     &NuBrick_Device_Descriptor::input_report_len},
+    {"output_report_len",    &NuBrick_Device_Descriptor::output_report_len},
+    {"getfeat_report_len",   &NuBrick_Device_Descriptor::getfeat_report_len},
+    {"setfeat_report_len",   &NuBrick_Device_Descriptor::setfeat_report_len},
+    {"cid",                  &NuBrick_Device_Descriptor::cid},
+    {"did",                  &NuBrick_Device_Descriptor::did},
+    {"pid",                  &NuBrick_Device_Descriptor::pid},
+    {"uid",                  &NuBrick_Device_Descriptor::uid},
+    {"ucid",                 &NuBrick_Device_Descriptor::ucid},
+};
+
+#define NUM_DEV_DESC_MEMBERS    (sizeof (dev_desc_members) / sizeof (dev_desc_members[0]))
+
+/* Names of reports, in order of members of NuBrickSnapshot */
+static const char * const report_names[] = {
+    "feature",
+    "input",
+    "output",
+};
+
+namespace {
+
+/** Bounded writer into caller buffer, latching overflow
+ */
+class NuBrickBufWriter {
+
+public:
+    NuBrickBufWriter(uint8_t *buf, size_t size) :
+        _buf(buf), _pos(buf), _end(buf + size), _overflow(false) {
+    }
+    
+    void put(uint8_t byte) {
+        if (_pos < _end) {
+            *_pos ++ = byte;
+        }
+        else {
+            _overflow = true;
+        }
+    }
+    
+    void put(const void *data, size_t length) {
+        if ((size_t) (_end - _pos) >= length) {
+            memcpy(_pos, data, length);
+            _pos += length;
+        }
+        else {
+            _overflow = true;
+        }
+    }
+    
+    /* JSON: unsigned decimal */
+    void put_dec(uint32_t value) {
+        char digits[10];
+        unsigned n = 0;
+        do {
+            digits[n ++] = '0' + (value % 10);
+            value /= 10;
+        } while (value);
+        while (n) {
+            put(digits[-- n]);
+        }
+    }
+    
+    /* JSON: "key": */
+    void put_key(const char *key) {
+        put('"');
+        put(key, strlen(key));
+        put('"');
+        put(':');
+    }
+    
+    /* CBOR: head of major type with argument */
+    void put_head(uint8_t major, uint32_t value) {
+        major <<= 5;
+        if (value < 24) {
+            put(major | value);
+        }
+        else if (value <= 0xFF) {
+            put(major | 24);
+            put(value);
+        }
+        else if (value <= 0xFFFF) {
+            put(major | 25);
+            put(value >> 8);
+            put(value);
+        }
+        else {
+            put(major | 26);
+            put(value >> 24);
+            put(value >> 16);
+            put(value >> 8);
+            put(value);
+        }
+    }
+    
+    /* CBOR: text string */
+    void put_text(const char *text) {
+        size_t length = strlen(text);
+        put_head(3, length);
+        put(text, length);
+    }
+    
+    size_t length(void) {
+        return _overflow ? 0 : (_pos - _buf);
+    }
+    
+private:
+    uint8_t *       _buf;
+    uint8_t *       _pos;
+    uint8_t *       _end;
+    bool            _overflow;
+};
+
+}
+
+/* CBOR major types */
+#define CBOR_UINT   0
+#define CBOR_TEXT   3
+#define CBOR_MAP    5
+
+size_t NuBrickSerializer::to_json(const NuBrickSnapshot &snapshot, char *buf, size_t size) {
+    
+    if (size == 0) {
+        return 0;
+    }
+    
+    // Reserve one byte for null terminator
+    NuBrickBufWriter writer((uint8_t *) buf, size - 1);
+    const NuBrickReportSnapshot *reports[] = {&snapshot.feature, &snapshot.input, &snapshot.output};
+    unsigned i, j;
+    
+    writer.put('{');
+    writer.put_key("addr");
+    writer.put_dec(snapshot.i2c_addr);
+    
+    writer.put(',');
+    writer.put_key("device");
+    writer.put('{');
+    for (i = 0; i < NUM_DEV_DESC_MEMBERS; i ++) {
+        if (i) {
+            writer.put(',');
+        }
+        writer.put_key(dev_desc_members[i].name);
+        writer.put_dec(snapshot.dev_desc.*dev_desc_members[i].member);
+    }
+    writer.put('}');
+    
+    for (i = 0; i < 3; i ++) {
+        writer.put(',');
+        writer.put_key(report_names[i]);
+        writer.put('{');
+        for (j = 0; j < reports[i]->num_fields; j ++) {
+            const NuBrickFieldSnapshot &field = reports[i]->fields[j];
+            if (j) {
+                writer.put(',');
+            }
+            writer.put_key(field.name);
+            writer.put('{');
+            writer.put_key("len");
+            writer.put_dec(field.length);
+            writer.put(',');
+            writer.put_key("value");
+            writer.put_dec(field.value);
+            writer.put(',');
+            writer.put_key("min");
+            writer.put_dec(field.minimum);
+            writer.put(',');
+            writer.put_key("max");
+            writer.put_dec(field.maximum);
+            writer.put('}');
+        }
+        writer.put('}');
+    }
+    writer.put('}');
+    
+    size_t length = writer.length();
+    buf[length] = '\0';
+    return length;
+}
+
+size_t NuBrickSerializer::to_cbor(const NuBrickSnapshot &snapshot, uint8_t *buf, size_t size) {
+    
+    NuBrickBufWriter writer(buf, size);
+    const NuBrickReportSnapshot *reports[] = {&snapshot.feature, &snapshot.input, &snapshot.output};
+    unsigned i, j;
+    
+    writer.put_head(CBOR_MAP, 5);
+    writer.put_text("addr");
+    writer.put_head(CBOR_UINT, snapshot.i2c_addr);
+    
+    writer.put_text("device");
+    writer.put_head(CBOR_MAP, NUM_DEV_DESC_MEMBERS);
+    for (i = 0; i < NUM_DEV_DESC_MEMBERS; i ++) {
+        writer.put_text(dev_desc_members[i].name);
+        writer.put_head(CBOR_UINT, snapshot.dev_desc.*dev_desc_members[i].member);
+    }
+    
+    for (i = 0; i < 3; i ++) {
+        writer.put_text(report_names[i]);
+        writer.put_head(CBOR_MAP, reports[i]->num_fields);
+        for (j = 0; j < reports[i]->num_fields; j ++) {
+            const NuBrickFieldSnapshot &field = reports[i]->fields[j];
+            writer.put_text(field.name);
+            writer.put_head(CBOR_MAP, 4);
+            writer.put_text("len");
+            writer.put_head(CBOR_UINT, field.length);
+            writer.put_text("value");
+            writer.put_head(CBOR_UINT, field.value);
+            writer.put_text("min");
+            writer.put_head(CBOR_UINT, field.minimum);
+            writer.put_text("max");
+            writer.put_head(CBOR_UINT, field.maximum);
+        }
+    }
+    
+    return writer.length();
+}
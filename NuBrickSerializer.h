@@ -0,0 +1,87 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_SERIALIZER_H
+#define NUBRICK_SERIALIZER_H
+
+#include "mbed.h"
+#include "nubrick_prot.h"
+
+/** Maximum number of fields per report in a snapshot
+ */
+#ifndef NUBRICK_MAX_SNAPSHOT_FIELDS
+#define NUBRICK_MAX_SNAPSHOT_FIELDS     16
+#endif
+
+/** Snapshot of one field
+ */
+struct NuBrickFieldSnapshot {
+    const char *    name;
+    uint16_t        length;
+    uint16_t        value;
+    uint16_t        minimum;
+    uint16_t        maximum;
+};
+
+/** Snapshot of one report
+ */
+struct NuBrickReportSnapshot {
+    unsigned                num_fields;
+    NuBrickFieldSnapshot    fields[NUBRICK_MAX_SNAPSHOT_FIELDS];
+};
+
+/** Consistent snapshot of device descriptor and reports of one NuBrickMaster object
+ */
+struct NuBrickSnapshot {
+    int                         i2c_addr;
+    NuBrick_Device_Descriptor   dev_desc;
+    NuBrickReportSnapshot       feature;
+    NuBrickReportSnapshot       input;
+    NuBrickReportSnapshot       output;
+};
+
+/** Serializers of NuBrickSnapshot into compact JSON or CBOR
+ *
+ * @note Synchronization level: Thread safe
+ *
+ * @details No printf or heap involved. Both formats share the same structure:
+ *          {"addr": N, "device": {"dev_desc_len": N, ..., "ucid": N},
+ *           "feature": {"<field>": {"len": N, "value": N, "min": N, "max": N}, ...},
+ *           "input": {...}, "output": {...}}
+ */
+class NuBrickSerializer {
+
+public:
+
+    /** Serialize snapshot into JSON, null-terminated
+     *
+     *  @param snapshot snapshot taken by NuBrickMaster::snapshot()
+     *  @param buf buffer to serialize into
+     *  @param size size of buf
+     *  @return length of JSON text excluding null terminator, 0 if buf is too small
+     */
+    static size_t to_json(const NuBrickSnapshot &snapshot, char *buf, size_t size);
+    
+    /** Serialize snapshot into CBOR (RFC 7049)
+     *
+     *  @param snapshot snapshot taken by NuBrickMaster::snapshot()
+     *  @param buf buffer to serialize into
+     *  @param size size of buf
+     *  @return length of CBOR data, 0 if buf is too small
+     */
+    static size_t to_cbor(const NuBrickSnapshot &snapshot, uint8_t *buf, size_t size);
+};
+
+#endif
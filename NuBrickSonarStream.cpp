@@ -0,0 +1,170 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickSonarStream.h"
+
+/* Thread flag to stop streaming thread */
+#define NUBRICK_SONAR_FLAG_STOP         0x1
+
+NuBrickSonarStream::NuBrickSonarStream() :
+    _num_entries(0), _slot_us(0), _thread(NULL), _running(false) {
+    
+    // No lock needed in the constructor
+}
+
+NuBrickSonarStream::~NuBrickSonarStream() {
+    
+    stop();
+}
+
+bool NuBrickSonarStream::add(NuBrickMasterSonar &sonar) {
+    
+    if (_thread || _num_entries >= NUBRICK_MAX_SONAR_STREAMS) {
+        return false;
+    }
+    
+    Entry *entry = _entries + _num_entries;
+    entry->sonar = &sonar;
+    entry->num_failures = 0;
+    entry->pace.reset();
+    _num_entries ++;
+    
+    return true;
+}
+
+bool NuBrickSonarStream::start(uint32_t rate_hz, osPriority priority) {
+    
+    if (_thread) {
+        return true;
+    }
+    if (rate_hz == 0 || _num_entries == 0) {
+        return false;
+    }
+    
+    uint32_t period_us = 1000000 / rate_hz;
+    _slot_us = period_us / _num_entries;
+    
+    unsigned i;
+    for (i = 0; i < _num_entries; i ++) {
+        Entry *entry = _entries + i;
+        
+        // Sonar keeps measuring on its own; error here just leaves it slower
+        tune_sleep_period(*entry->sonar, period_us / 1000);
+        
+        _mutex.lock();
+        entry->num_failures = 0;
+        entry->pace.reset();
+        _mutex.unlock();
+    }
+    
+    _running = true;
+    _thread = new rtos::Thread(priority);
+    if (_thread->start(mbed::callback(this, &NuBrickSonarStream::thread_main)) != osOK) {
+        delete _thread;
+        _thread = NULL;
+        _running = false;
+        return false;
+    }
+    
+    return true;
+}
+
+void NuBrickSonarStream::stop(void) {
+    
+    if (! _thread) {
+        return;
+    }
+    
+    _running = false;
+    _thread->flags_set(NUBRICK_SONAR_FLAG_STOP);
+    _thread->join();
+    delete _thread;
+    _thread = NULL;
+}
+
+bool NuBrickSonarStream::get_stats(unsigned index, NuBrickSonarStats &stats) {
+    
+    if (index >= _num_entries) {
+        return false;
+    }
+    
+    // Support thread-safe
+    _mutex.lock();
+    
+    const Entry *entry = _entries + index;
+    
+    stats.num_samples = entry->pace.get_num_samples();
+    stats.num_failures = entry->num_failures;
+    stats.jitter_mean = entry->pace.get_jitter_mean();
+    stats.jitter_max = entry->pace.get_jitter_max();
+    stats.rate = entry->pace.get_rate();
+    
+    _mutex.unlock();
+    
+    return true;
+}
+
+bool NuBrickSonarStream::tune_sleep_period(NuBrickMasterSonar &sonar, uint32_t period_ms) {
+    
+    if (! sonar.pull_feature_report()) {
+        return false;
+    }
+    
+    // Let Sonar measure at least twice per pull, within its supported range
+    NuBrickField &sleep_period = sonar["feature.sleep_period"];
+    uint32_t value = period_ms / 2;
+    if (value < sleep_period.get_minimum()) {
+        value = sleep_period.get_minimum();
+    }
+    if (value > sleep_period.get_maximum()) {
+        value = sleep_period.get_maximum();
+    }
+    sleep_period.set_value(value);
+    
+    return sonar.push_feature_report();
+}
+
+void NuBrickSonarStream::thread_main(void) {
+    
+    NuBrickPacer pacer;
+    uint64_t slot = 0;
+    
+    pacer.start();
+    while (_running) {
+        // Wait for next slot; Sonars take turns so reads are evenly spaced
+        uint64_t offset_us = slot * _slot_us;
+        pacer.wait_until(offset_us, NUBRICK_SONAR_FLAG_STOP);
+        if (! _running) {
+            break;
+        }
+        
+        uint64_t now_us = pacer.elapsed_us();
+        uint32_t jitter = NuBrickPacer::abs_us((int64_t) now_us - (int64_t) offset_us);
+        
+        Entry *entry = _entries + (slot % _num_entries);
+        bool success = entry->sonar->pull_input_report();
+        
+        _mutex.lock();
+        if (success) {
+            entry->pace.add(now_us, jitter);
+        }
+        else {
+            entry->num_failures ++;
+        }
+        _mutex.unlock();
+        
+        slot ++;
+    }
+}
@@ -0,0 +1,110 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_SONAR_STREAM_H
+#define NUBRICK_SONAR_STREAM_H
+
+#include "mbed.h"
+#include "NuBrickMasterSonar.h"
+#include "NuBrickPacer.h"
+
+/** Maximum number of Sonar modules streamed by one NuBrickSonarStream object
+ */
+#ifndef NUBRICK_MAX_SONAR_STREAMS
+#define NUBRICK_MAX_SONAR_STREAMS       4
+#endif
+
+/** Statistics of one Sonar stream
+ */
+struct NuBrickSonarStats {
+    uint32_t    rate;                       // Achieved rate of filtered distance in mHz
+    uint32_t    jitter_mean;                // Mean lateness of pull against schedule in us
+    uint32_t    jitter_max;                 // Maximum lateness of pull against schedule in us
+    uint32_t    num_samples;                // Number of successful pulls
+    uint32_t    num_failures;               // Number of failed pulls
+};
+
+/** A streaming mode of multiple NuMaker Brick I2C slave modules Sonar
+ *
+ * @note Synchronization level: Thread safe
+ *
+ * @details On start(), "feature.sleep_period" of each Sonar is tuned for burst sampling at
+ *          the stream rate. One thread then pulls the Sonars in turn, staggered evenly over
+ *          the stream period so their reads are evenly spaced on the bus. Each pull runs the
+ *          filter chosen with NuBrickMasterSonar::set_filter().
+ */
+class NuBrickSonarStream {
+
+public:
+
+    NuBrickSonarStream();
+
+    virtual ~NuBrickSonarStream();
+    
+    /** Add Sonar to the stream
+     *
+     *  @param sonar connected NuBrickMasterSonar object
+     *  @return true if success, false if failure
+     *
+     *  @note Add all Sonars before start().
+     */
+    bool add(NuBrickMasterSonar &sonar);
+    
+    /** Start streaming
+     *
+     *  @param rate_hz rate of each Sonar in Hz
+     *  @param priority priority of the streaming thread
+     *  @return true if success, false if failure
+     */
+    bool start(uint32_t rate_hz = 50, osPriority priority = osPriorityAboveNormal);
+    
+    /** Stop streaming
+     */
+    void stop(void);
+    
+    /** Get statistics of one Sonar stream
+     *
+     *  @param index index of Sonar in order of add()
+     *  @param stats statistics
+     *  @return true if success, false if failure
+     */
+    bool get_stats(unsigned index, NuBrickSonarStats &stats);
+    
+protected:
+    /** Stream of one Sonar
+     */
+    struct Entry {
+        NuBrickMasterSonar *            sonar;
+        uint32_t                        num_failures;
+        NuBrickPaceStats                pace;
+    };
+    
+    Entry                               _entries[NUBRICK_MAX_SONAR_STREAMS];
+    unsigned                            _num_entries;
+    uint32_t                            _slot_us;
+    rtos::Mutex                         _mutex;
+    rtos::Thread *                      _thread;
+    volatile bool                       _running;
+    
+    /** Tune "feature.sleep_period" of Sonar for burst sampling at period_ms
+     */
+    bool tune_sleep_period(NuBrickMasterSonar &sonar, uint32_t period_ms);
+    
+    /** Thread entry of start()
+     */
+    void thread_main(void);
+};
+
+#endif
@@ -0,0 +1,295 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickTimeline.h"
+#include "hal/us_ticker_api.h"
+
+/* Thread flags of executor thread */
+#define NUBRICK_TIMELINE_FLAG_WAKEUP    0x1
+#define NUBRICK_TIMELINE_FLAG_STOP      0x2
+
+NuBrickTimeline::NuBrickTimeline(uint32_t tick_ms) :
+    _num_events(0), _seq(0), _tick_ms(tick_ms), _lateness_sum(0), _base_us(0),
+    _thread(NULL), _running(false) {
+    
+    // No lock needed in the constructor
+    
+    memset(&_stats, 0x00, sizeof (_stats));
+}
+
+NuBrickTimeline::~NuBrickTimeline() {
+    
+    stop();
+}
+
+int NuBrickTimeline::submit(NuBrickMaster &master, const char *report_field_name, uint16_t value, rtos::Kernel::Clock::time_point deadline) {
+    
+    Event event;
+    
+    // Only feature/output fields get pushed
+    int position = (report_field_name == NULL) ? -1 : master.get_field_position(report_field_name);
+    if (position < 0) {
+        return -1;
+    }
+    if (strncmp(report_field_name, "output.", 7) == 0) {
+        event.output = true;
+    }
+    else if (strncmp(report_field_name, "feature.", 8) == 0) {
+        event.output = false;
+    }
+    else {
+        return -1;
+    }
+    
+    event.deadline = deadline;
+    event.master = &master;
+    event.position = position;
+    event.value = value;
+    
+    // Support thread-safe
+    _mutex.lock();
+    
+    if (_num_events >= NUBRICK_MAX_TIMELINE_EVENTS) {
+        _mutex.unlock();
+        return -1;
+    }
+    
+    event.seq = _seq ++;
+    bool earliest = (_num_events == 0) || earlier(event, _heap[0]);
+    heap_push(event);
+    int id = (int) (event.seq & 0x7FFFFFFF);
+    
+    _mutex.unlock();
+    
+    // Executor may sleep past the new earliest deadline
+    if (earliest && _thread) {
+        _thread->flags_set(NUBRICK_TIMELINE_FLAG_WAKEUP);
+    }
+    
+    return id;
+}
+
+void NuBrickTimeline::attach(EventCallback cb) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    _cb = cb;
+    
+    _mutex.unlock();
+}
+
+bool NuBrickTimeline::start(osPriority priority) {
+    
+    if (_thread) {
+        return true;
+    }
+    
+    _running = true;
+    _thread = new rtos::Thread(priority);
+    if (_thread->start(mbed::callback(this, &NuBrickTimeline::thread_main)) != osOK) {
+        delete _thread;
+        _thread = NULL;
+        _running = false;
+        return false;
+    }
+    
+    return true;
+}
+
+void NuBrickTimeline::stop(void) {
+    
+    if (! _thread) {
+        return;
+    }
+    
+    _running = false;
+    _thread->flags_set(NUBRICK_TIMELINE_FLAG_STOP);
+    _thread->join();
+    delete _thread;
+    _thread = NULL;
+    
+    _mutex.lock();
+    _num_events = 0;
+    _mutex.unlock();
+}
+
+void NuBrickTimeline::get_stats(NuBrickTimelineStats &stats) {
+    // Support thread-safe
+    _mutex.lock();
+    
+    stats = _stats;
+    stats.lateness_mean = _stats.events_applied ? (uint32_t) (_lateness_sum / _stats.events_applied) : 0;
+    
+    _mutex.unlock();
+}
+
+bool NuBrickTimeline::earlier(const Event &a, const Event &b) {
+    
+    if (a.deadline != b.deadline) {
+        return a.deadline < b.deadline;
+    }
+    
+    return (int32_t) (a.seq - b.seq) < 0;
+}
+
+void NuBrickTimeline::heap_push(const Event &event) {
+    
+    unsigned pos = _num_events ++;
+    
+    // Sift up
+    while (pos > 0) {
+        unsigned parent = (pos - 1) / 2;
+        if (! earlier(event, _heap[parent])) {
+            break;
+        }
+        _heap[pos] = _heap[parent];
+        pos = parent;
+    }
+    _heap[pos] = event;
+}
+
+void NuBrickTimeline::heap_pop(Event &event) {
+    
+    event = _heap[0];
+    
+    const Event &last = _heap[-- _num_events];
+    unsigned pos = 0;
+    
+    // Sift down
+    while (true) {
+        unsigned child = 2 * pos + 1;
+        if (child >= _num_events) {
+            break;
+        }
+        if ((child + 1) < _num_events && earlier(_heap[child + 1], _heap[child])) {
+            child ++;
+        }
+        if (! earlier(_heap[child], last)) {
+            break;
+        }
+        _heap[pos] = _heap[child];
+        pos = child;
+    }
+    _heap[pos] = last;
+}
+
+void NuBrickTimeline::thread_main(void) {
+    
+    // Map kernel clock to us ticker for lateness in us
+    _base_tp = rtos::Kernel::Clock::now();
+    _base_us = us_ticker_read();
+    
+    Event batch[NUBRICK_MAX_TIMELINE_EVENTS];
+    
+    while (_running) {
+        _mutex.lock();
+        
+        if (_num_events == 0) {
+            _mutex.unlock();
+            rtos::ThisThread::flags_wait_any(NUBRICK_TIMELINE_FLAG_WAKEUP | NUBRICK_TIMELINE_FLAG_STOP);
+            continue;
+        }
+        
+        rtos::Kernel::Clock::time_point now = rtos::Kernel::Clock::now();
+        if (_heap[0].deadline > now) {
+            rtos::Kernel::Clock::time_point deadline = _heap[0].deadline;
+            _mutex.unlock();
+            rtos::ThisThread::flags_wait_any_until(NUBRICK_TIMELINE_FLAG_WAKEUP | NUBRICK_TIMELINE_FLAG_STOP, deadline);
+            continue;
+        }
+        
+        // Take all events due within this tick, in EDF order
+        rtos::Kernel::Clock::time_point tick_end = now + std::chrono::milliseconds(_tick_ms);
+        unsigned num_batch = 0;
+        while (_num_events && _heap[0].deadline < tick_end) {
+            heap_pop(batch[num_batch ++]);
+        }
+        EventCallback cb = _cb;
+        
+        _mutex.unlock();
+        
+        // Push each affected report once, in order of its earliest event
+        unsigned i, j;
+        for (i = 0; i < num_batch; i ++) {
+            bool pushed_before = false;
+            for (j = 0; j < i; j ++) {
+                if (batch[j].master == batch[i].master && batch[j].output == batch[i].output) {
+                    pushed_before = true;
+                    break;
+                }
+            }
+            if (pushed_before) {
+                continue;
+            }
+            
+            // Build the report from a copy of local fields, shared fields are never written unlocked
+            NuBrickMaster *master = batch[i].master;
+            bool output = batch[i].output;
+            uint16_t values[NUBRICK_MAX_REPORT_FIELDS];
+            uint8_t frame[NUBRICK_TIMELINE_FRAME_MAX];
+            unsigned num_values = output ? master->get_output_values(values, NUBRICK_MAX_REPORT_FIELDS) : master->get_feature_values(values, NUBRICK_MAX_REPORT_FIELDS);
+            uint32_t field_mask = 0;
+            for (j = i; j < num_batch; j ++) {
+                if (batch[j].master == master && batch[j].output == output && (unsigned) batch[j].position < num_values) {
+                    values[batch[j].position] = batch[j].value;
+                    field_mask |= (1UL << batch[j].position);
+                }
+            }
+            
+            unsigned length = output ? master->build_output_frame(values, num_values, frame, sizeof (frame)) : master->build_feature_frame(values, num_values, frame, sizeof (frame));
+            bool success = length && master->push_frame(frame, length);
+            if (success) {
+                // Commit only fields of the batch, others may have changed meanwhile
+                if (output) {
+                    master->set_output_values(values, num_values, field_mask);
+                }
+                else {
+                    master->set_feature_values(values, num_values, field_mask);
+                }
+            }
+            uint32_t done_us = us_ticker_read() - _base_us;
+            
+            _mutex.lock();
+            _stats.pushes ++;
+            _mutex.unlock();
+            
+            // Account all events of this report
+            for (j = i; j < num_batch; j ++) {
+                if (batch[j].master != batch[i].master || batch[j].output != batch[i].output) {
+                    continue;
+                }
+                
+                uint32_t deadline_us = (uint32_t) std::chrono::duration_cast<std::chrono::microseconds>(batch[j].deadline - _base_tp).count();
+                int32_t lateness_us = (int32_t) (done_us - deadline_us);
+                uint32_t abs_lateness_us = (lateness_us < 0) ? -lateness_us : lateness_us;
+                
+                _mutex.lock();
+                _stats.events_applied ++;
+                if (! success) {
+                    _stats.events_failed ++;
+                }
+                _lateness_sum += abs_lateness_us;
+                if (abs_lateness_us > _stats.lateness_max) {
+                    _stats.lateness_max = abs_lateness_us;
+                }
+                _mutex.unlock();
+                
+                if (cb) {
+                    cb((int) (batch[j].seq & 0x7FFFFFFF), lateness_us, success);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,148 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_TIMELINE_H
+#define NUBRICK_TIMELINE_H
+
+#include "mbed.h"
+#include "NuBrickMaster.h"
+
+/** Maximum frame size of one pushed report, as of the I2C buffer of NuBrickMaster
+ */
+#ifndef NUBRICK_TIMELINE_FRAME_MAX
+#define NUBRICK_TIMELINE_FRAME_MAX      80
+#endif
+
+/** Maximum number of pending events of one NuBrickTimeline object
+ */
+#ifndef NUBRICK_MAX_TIMELINE_EVENTS
+#define NUBRICK_MAX_TIMELINE_EVENTS     32
+#endif
+
+/** Statistics of timeline
+ */
+struct NuBrickTimelineStats {
+    uint32_t    events_applied;             // Number of events applied
+    uint32_t    events_failed;              // Number of events whose report failed to push
+    uint32_t    pushes;                     // Number of report pushes, less than events when batched
+    uint32_t    lateness_mean;              // Mean lateness of event against deadline in us
+    uint32_t    lateness_max;               // Maximum lateness of event against deadline in us
+};
+
+/** A timeline scheduler for coordinated actuation of NuMaker Brick I2C slave modules on one bus
+ *
+ * @note Synchronization level: Thread safe
+ *
+ * @details Submit timestamped changes of feature/output fields of any set of modules. A single
+ *          executor thread applies them at their deadlines in earliest-deadline-first order.
+ *          Changes whose deadlines fall in the same tick are batched: each affected report is
+ *          pushed once, built from a copy of the local fields with the batch applied. Local
+ *          fields take the new values only after the push succeeds. Lateness of each event is measured once its report is pushed.
+ *
+ *          Use one NuBrickTimeline object per I2C bus.
+ */
+class NuBrickTimeline {
+
+public:
+
+    /** Callback type of event completion
+     *
+     *  @param id event id returned by submit()
+     *  @param lateness_us lateness against deadline in us, negative for early
+     *  @param success true if report pushed, false if failed
+     *
+     *  @note Invoked in context of the executor thread
+     */
+    typedef mbed::Callback<void(int id, int32_t lateness_us, bool success)> EventCallback;
+
+    /** Create a timeline scheduler
+     *
+     *  @param tick_ms batch window in ms: events with deadlines within one tick are applied together
+     */
+    NuBrickTimeline(uint32_t tick_ms = 1);
+
+    virtual ~NuBrickTimeline();
+    
+    /** Submit a change of one feature/output field, e.g. "output.start_flag"
+     *
+     *  @param master connected NuBrickMaster object
+     *  @param report_field_name name of feature/output field
+     *  @param value value to set
+     *  @param deadline time to apply the change at
+     *  @return event id if success, -1 if failure
+     */
+    int submit(NuBrickMaster &master, const char *report_field_name, uint16_t value, rtos::Kernel::Clock::time_point deadline);
+    
+    /** Attach callback of event completion
+     */
+    void attach(EventCallback cb);
+    
+    /** Start executor thread
+     *
+     *  @return true if success, false if failure
+     */
+    bool start(osPriority priority = osPriorityHigh);
+    
+    /** Stop executor thread. Pending events are discarded.
+     */
+    void stop(void);
+    
+    /** Get statistics of timeline
+     */
+    void get_stats(NuBrickTimelineStats &stats);
+    
+protected:
+    /** Pending event
+     */
+    struct Event {
+        rtos::Kernel::Clock::time_point deadline;
+        uint32_t                        seq;        // Submission order, tie-breaker of equal deadlines
+        NuBrickMaster *                 master;
+        int                             position;   // Position of field in its report
+        uint16_t                        value;
+        bool                            output;     // Output report, otherwise feature report
+    };
+    
+    Event                               _heap[NUBRICK_MAX_TIMELINE_EVENTS];
+    unsigned                            _num_events;
+    uint32_t                            _seq;
+    uint32_t                            _tick_ms;
+    EventCallback                       _cb;
+    NuBrickTimelineStats                _stats;
+    uint64_t                            _lateness_sum;
+    rtos::Kernel::Clock::time_point     _base_tp;
+    uint32_t                            _base_us;
+    rtos::Mutex                         _mutex;
+    rtos::Thread *                      _thread;
+    volatile bool                       _running;
+    
+    /** Is event a due earlier than event b?
+     */
+    static bool earlier(const Event &a, const Event &b);
+    
+    /** Push event into EDF heap
+     */
+    void heap_push(const Event &event);
+    
+    /** Pop earliest event from EDF heap
+     */
+    void heap_pop(Event &event);
+    
+    /** Thread entry of start()
+     */
+    void thread_main(void);
+};
+
+#endif
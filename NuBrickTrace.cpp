@@ -0,0 +1,120 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NuBrickTrace.h"
+#include "hal/us_ticker_api.h"
+#include "targets/TARGET_NUVOTON/nu_bitutil.h"
+
+NuBrickTrace::NuBrickTrace(NuBrickTraceEntry *entries, unsigned num_entries) :
+    _entries(entries), _num_entries(num_entries), _head(0), _count(0), _overwritten(0) {
+    
+    // No lock needed in the constructor
+}
+
+void NuBrickTrace::record(uint8_t flags, int address, uint16_t command, int length, int status) {
+    
+    if (_num_entries == 0) {
+        return;
+    }
+    
+    uint32_t now_us = us_ticker_read();
+    
+    // Support interrupt-safe. Only a handful of stores, cheaper than a mutex.
+    core_util_critical_section_enter();
+    
+    NuBrickTraceEntry *entry = _entries + _head;
+    entry->timestamp = now_us;
+    entry->address = (uint8_t) address;
+    entry->flags = flags;
+    entry->command = command;
+    entry->length = (uint16_t) length;
+    entry->status = (int16_t) status;
+    
+    if (++ _head == _num_entries) {
+        _head = 0;
+    }
+    if (_count < _num_entries) {
+        _count ++;
+    }
+    else {
+        _overwritten ++;
+    }
+    
+    core_util_critical_section_exit();
+}
+
+size_t NuBrickTrace::dump(uint8_t *buf, size_t size) {
+    
+    const size_t header_size = 12;
+    const size_t entry_size = 12;
+    
+    if (size < header_size) {
+        return 0;
+    }
+    
+    unsigned max_entries = (size - header_size) / entry_size;
+    uint8_t *pos = buf + header_size;
+    
+    core_util_critical_section_enter();
+    unsigned count = _count;
+    unsigned tail = (_head + _num_entries - _count) % (_num_entries ? _num_entries : 1);
+    uint32_t overwritten = _overwritten;
+    core_util_critical_section_exit();
+    
+    if (count > max_entries) {
+        count = max_entries;
+    }
+    
+    // Copy entry by entry so that interrupts are never held off for long
+    unsigned i;
+    for (i = 0; i < count; i ++) {
+        NuBrickTraceEntry entry;
+        
+        core_util_critical_section_enter();
+        entry = _entries[(tail + i) % _num_entries];
+        core_util_critical_section_exit();
+        
+        nu_set32_le(pos, entry.timestamp);
+        pos[4] = entry.address;
+        pos[5] = entry.flags;
+        nu_set16_le(pos + 6, entry.command);
+        nu_set16_le(pos + 8, entry.length);
+        nu_set16_le(pos + 10, (uint16_t) entry.status);
+        pos += entry_size;
+    }
+    
+    memcpy(buf, NUBRICK_TRACE_MAGIC, 4);
+    nu_set16_le(buf + 4, entry_size);
+    nu_set16_le(buf + 6, count);
+    nu_set32_le(buf + 8, overwritten);
+    
+    return pos - buf;
+}
+
+unsigned NuBrickTrace::count(void) {
+    
+    return _count;
+}
+
+void NuBrickTrace::reset(void) {
+    
+    core_util_critical_section_enter();
+    
+    _head = 0;
+    _count = 0;
+    _overwritten = 0;
+    
+    core_util_critical_section_exit();
+}
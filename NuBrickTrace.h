@@ -0,0 +1,103 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_TRACE_H
+#define NUBRICK_TRACE_H
+
+#include "mbed.h"
+
+/** Binary trace dump: magic
+ */
+#define NUBRICK_TRACE_MAGIC             "NBT1"
+
+/** One entry of binary trace of I2C transfers
+ *
+ *  @note Dumped as is in little-endian, 12 bytes per entry
+ */
+struct NuBrickTraceEntry {
+    uint32_t    timestamp;                  // us ticker at end of transfer
+    uint8_t     address;                    // 8-bit I2C slave address
+    uint8_t     flags;                      // Combination of NuBrick_RecordFlag
+    uint16_t    command;                    // NuBrick_Comm of the transaction the transfer belongs to
+    uint16_t    length;                     // Length of data written/read
+    int16_t     status;                     // Return code of I2C write/read, 0 on success (ack)
+};
+
+/** A ring trace of I2C transfers of NuBrickMaster objects, cheap enough to keep on in production
+ *
+ * @note Synchronization level: Interrupt safe
+ *
+ * @details Unlike NuBrickRecorder, no data is recorded and oldest entries get overwritten when
+ *          the ring is full. Call dump() after the fact and decode with tools/nubrick_trace.py.
+ *
+ *          Dump format, all little-endian:
+ *          - 4 bytes: magic NUBRICK_TRACE_MAGIC
+ *          - 2 bytes: size of one entry, sizeof (NuBrickTraceEntry)
+ *          - 2 bytes: number of entries dumped
+ *          - 4 bytes: number of entries overwritten before dump
+ *          - Entries, oldest first
+ */
+class NuBrickTrace {
+
+public:
+
+    /** Create a trace ring
+     *
+     *  @param entries ring buffer of entries
+     *  @param num_entries number of entries of ring buffer
+     */
+    NuBrickTrace(NuBrickTraceEntry *entries, unsigned num_entries);
+
+    virtual ~NuBrickTrace() {
+        // Do nothing
+    }
+    
+    /** Record one I2C transfer
+     *
+     *  @param flags combination of NuBrick_RecordFlag
+     *  @param address 8-bit I2C slave address
+     *  @param command NuBrick_Comm of the transaction
+     *  @param length length of data written/read
+     *  @param status return code of I2C write/read
+     */
+    void record(uint8_t flags, int address, uint16_t command, int length, int status);
+    
+    /** Dump trace, oldest entry first
+     *
+     *  @param buf buffer to dump into
+     *  @param size size of buf
+     *  @return size of dump, 0 if buf is too small even for the header
+     *
+     *  @note Entries that don't fit are dropped, newest first
+     */
+    size_t dump(uint8_t *buf, size_t size);
+    
+    /** Get number of entries in trace
+     */
+    unsigned count(void);
+    
+    /** Discard trace
+     */
+    void reset(void);
+    
+protected:
+    NuBrickTraceEntry *                 _entries;
+    const unsigned                      _num_entries;
+    unsigned                            _head;          // Next entry to write
+    unsigned                            _count;
+    uint32_t                            _overwritten;
+};
+
+#endif
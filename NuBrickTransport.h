@@ -0,0 +1,55 @@
+/* mbed Microcontroller Library
+ * Copyright (c) 2016 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NUBRICK_TRANSPORT_H
+#define NUBRICK_TRANSPORT_H
+
+#include "mbed.h"
+
+/** Bus transport of NuBrickMaster replacing I2C object, e.g. for replaying recorded sessions
+ *
+ * @details Semantics follow I2C::write()/I2C::read(): address is 8-bit I2C slave address, and
+ *          return value is 0 on success (ack), non-zero on failure (nack).
+ */
+class NuBrickTransport {
+
+public:
+
+    virtual ~NuBrickTransport() {
+        // Do nothing
+    }
+    
+    /** Write to an I2C slave
+     *
+     *  @param address 8-bit I2C slave address [ addr | 0 ]
+     *  @param data pointer to the byte-array data to send
+     *  @param length number of bytes to send
+     *  @param repeated repeated start, true - don't send stop at end
+     *  @return 0 on success (ack), non-zero on failure (nack)
+     */
+    virtual int write(int address, const char *data, int length, bool repeated = false) = 0;
+    
+    /** Read from an I2C slave
+     *
+     *  @param address 8-bit I2C slave address [ addr | 1 ]
+     *  @param data pointer to the byte-array to read data in to
+     *  @param length number of bytes to read
+     *  @param repeated repeated start, true - don't send stop at end
+     *  @return 0 on success (ack), non-zero on failure (nack)
+     */
+    virtual int read(int address, char *data, int length, bool repeated = false) = 0;
+};
+
+#endif
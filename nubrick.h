@@ -25,5 +25,22 @@
 #include "NuBrickMasterGas.h"
 #include "NuBrickMasterIR.h"
 #include "NuBrickMasterKeys.h"
+#include "NuBrickPollScheduler.h"
+#include "NuBrickAggregator.h"
+#include "NuBrickConverter.h"
+#include "NuBrickRecorder.h"
+#include "NuBrickReplayTransport.h"
+#include "NuBrickSonarStream.h"
+#include "NuBrickAHRSSpectrum.h"
+#include "NuBrickKeyEvents.h"
+#include "NuBrickIRCodes.h"
+#include "NuBrickLEDAnimator.h"
+#include "NuBrickBuzzerSequencer.h"
+#include "NuBrickTimeline.h"
+#include "NuBrickTrace.h"
+#include "NuBrickSerializer.h"
+#include "NuBrickLog.h"
+#include "NuBrickBusWorker.h"
+#include "NuBrickI2CMux.h"
 
 #endif
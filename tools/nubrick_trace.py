@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2016 ARM Limited
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Decode a binary trace dumped by NuBrickTrace::dump()
+
+Usage: nubrick_trace.py <dump.bin>
+"""
+
+import struct
+import sys
+
+MAGIC = b"NBT1"
+
+COMMANDS = {
+    0: "None",
+    1: "GetDeviceDesc",
+    2: "GetReportDesc",
+    3: "GetInputReport",
+    4: "SetOutputReport",
+    5: "GetFeatureReport",
+    6: "SetFeatureReport",
+}
+
+FLAG_READ = 0x01
+FLAG_REPEATED = 0x02
+FLAG_FAILED = 0x04
+
+
+def decode(data):
+    if len(data) < 12 or data[0:4] != MAGIC:
+        raise ValueError("not a NuBrick trace dump")
+
+    entry_size, count, overwritten = struct.unpack_from("<HHI", data, 4)
+    entries = []
+    pos = 12
+    for _ in range(count):
+        if pos + entry_size > len(data):
+            raise ValueError("truncated dump")
+        entries.append(struct.unpack_from("<IBBHHh", data, pos))
+        pos += entry_size
+
+    return overwritten, entries
+
+
+def main(argv):
+    if len(argv) != 2:
+        sys.stderr.write(__doc__)
+        return 2
+
+    with open(argv[1], "rb") as f:
+        overwritten, entries = decode(f.read())
+
+    print("# %d entries, %d overwritten" % (len(entries), overwritten))
+    print("%12s %10s %5s %5s %-18s %5s %6s" % ("time_us", "delta_us", "addr", "dir", "command", "len", "status"))
+
+    prev = None
+    for timestamp, address, flags, command, length, status in entries:
+        # us ticker is 32-bit and wraps
+        delta = 0 if prev is None else (timestamp - prev) & 0xFFFFFFFF
+        prev = timestamp
+        direction = "R" if flags & FLAG_READ else "W"
+        if flags & FLAG_REPEATED:
+            direction += "+"
+        print("%12d %10d  0x%02x %5s %-18s %5d %6s" % (
+            timestamp, delta, address, direction, COMMANDS.get(command, str(command)), length,
+            "NAK(%d)" % status if flags & FLAG_FAILED else "ok"))
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))